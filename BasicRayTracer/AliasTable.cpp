@@ -0,0 +1,67 @@
+//
+//  AliasTable.cpp
+//  BasicRayTracer
+//
+//  http://www.keithschwarz.com/darts-dice-coins/
+
+#include "AliasTable.h"
+#include <math.h>
+#define ONE_MINUS_EPSILON 0.99999994f
+
+void AliasTable::build(const std::vector<float> &weights){
+    size_t n = weights.size();
+    probabilities.assign(n, 0);
+    threshold.assign(n, 1);
+    alias.assign(n, 0);
+    sum = 0;
+    for (float w: weights) {
+        sum += w;
+    }
+    if (sum <= 0) { return; }
+
+    // Scale so the average bucket holds exactly 1, then pair up small and large buckets.
+    std::vector<float> scaled(n);
+    std::vector<int> small, large;
+    for (size_t i = 0; i < n; i++) {
+        probabilities[i] = weights[i] / sum;
+        scaled[i] = probabilities[i] * n;
+        if (scaled[i] < 1) {
+            small.push_back((int)i);
+        } else {
+            large.push_back((int)i);
+        }
+    }
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(); small.pop_back();
+        int l = large.back(); large.pop_back();
+        threshold[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1;
+        if (scaled[l] < 1) {
+            small.push_back(l);
+        } else {
+            large.push_back(l);
+        }
+    }
+    // Whatever is left is 1 up to rounding error.
+    for (int i: large) { threshold[i] = 1; alias[i] = i; }
+    for (int i: small) { threshold[i] = 1; alias[i] = i; }
+}
+
+int AliasTable::sample(const float u, float &remapped) const {
+    size_t n = threshold.size();
+    float scaled = u * n;
+    size_t bucket = scaled < n ? (size_t)scaled : n - 1;
+    float fraction = scaled - bucket;
+    if (fraction < threshold[bucket]) {
+        remapped = fminf(fraction / threshold[bucket], ONE_MINUS_EPSILON);
+        return (int)bucket;
+    }
+    remapped = fminf((fraction - threshold[bucket]) / (1 - threshold[bucket]), ONE_MINUS_EPSILON);
+    return alias[bucket];
+}
+
+int AliasTable::sample(const float u) const {
+    float unused;
+    return sample(u, unused);
+}
@@ -0,0 +1,35 @@
+//
+//  AliasTable.h
+//  BasicRayTracer
+//
+//  Walker/Vose alias table: O(1) sampling of a discrete distribution.
+//
+
+#ifndef __BasicRayTracer__AliasTable__
+#define __BasicRayTracer__AliasTable__
+
+#include <vector>
+
+class AliasTable {
+private:
+    std::vector<float> probabilities; // Normalized weights, for pdf lookups.
+    std::vector<float> threshold;
+    std::vector<int> alias;
+    float sum;
+public:
+    AliasTable():sum(0){};
+    AliasTable(const std::vector<float> &weights){ build(weights); };
+    void build(const std::vector<float> &weights);
+
+    /* Pick an index with probability proportional to its weight from one uniform number in [0,1).
+       `remapped` receives a fresh uniform number in [0,1), so the caller can reuse it. */
+    int sample(const float u, float &remapped) const;
+    int sample(const float u) const;
+
+    float pdf(const int index) const { return probabilities[index]; };
+    float total() const { return sum; };
+    size_t size() const { return probabilities.size(); };
+    bool empty() const { return sum <= 0; };
+};
+
+#endif /* defined(__BasicRayTracer__AliasTable__) */
@@ -0,0 +1,458 @@
+//
+//  AsciiSceneReader.cpp
+//  BasicRayTracer
+//
+
+#include "AsciiSceneReader.h"
+#include "Profiler.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string.h>
+#include <charconv>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace {
+
+// Character classes, looked up instead of compared since whitespace is most of the file.
+enum { BLANK = 1, BRACE = 2 };
+struct CharacterClasses {
+    unsigned char table[256];
+    CharacterClasses(){
+        memset(table, 0, sizeof(table));
+        table[(unsigned char)' '] = table[(unsigned char)'\t'] = table[(unsigned char)'\n'] = BLANK;
+        table[(unsigned char)'\r'] = table[(unsigned char)'\v'] = table[(unsigned char)'\f'] = BLANK;
+        table[(unsigned char)'{'] = table[(unsigned char)'}'] = BRACE;
+    }
+};
+const CharacterClasses classes;
+
+inline bool isBlank(const char c){
+    return classes.table[(unsigned char)c] == BLANK;
+}
+
+inline bool isDelimiter(const char c){
+    return classes.table[(unsigned char)c] != 0;
+}
+
+// Clinger's fast path. A decimal with at most 7 significant digits and 10
+// fractional places is an exact float divided by an exact power of ten, so
+// the single correctly rounded division equals what from_chars returns.
+// Anything else (exponents, long mantissas) is left to from_chars.
+const float POWERS_OF_TEN[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+inline bool parseShortDecimal(const char *&p, const char *end, float &out){
+    const char *q = p;
+    bool negative = q < end && *q == '-';
+    if (q < end && (*q == '-' || *q == '+')) { q++; }
+    uint32_t mantissa = 0;
+    int digits = 0, scale = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++, digits++) {
+        mantissa = mantissa * 10 + (*q - '0');
+    }
+    if (q < end && *q == '.') {
+        for (q++; q < end && *q >= '0' && *q <= '9'; q++, digits++, scale++) {
+            mantissa = mantissa * 10 + (*q - '0');
+        }
+    }
+    if (digits == 0 || digits > 9 || scale > 10 || mantissa > (1u << 24)) { return false; }
+    if (q < end && !isDelimiter(*q)) { return false; }
+    float value = (float)mantissa / POWERS_OF_TEN[scale];
+    out = negative ? -value : value;
+    p = q;
+    return true;
+}
+
+}
+
+#pragma mark - Tokens
+
+bool AsciiSceneReader::Token::equals(const char *word) const {
+    return strncmp(text, word, length) == 0 && word[length] == '\0';
+}
+
+inline bool AsciiSceneReader::Cursor::atEnd(){
+    while (p < reader.end && isBlank(*p)) { p++; }
+    return p >= reader.end;
+}
+
+// Words are split on whitespace, and braces are always tokens of their own.
+AsciiSceneReader::Token AsciiSceneReader::Cursor::peek(){
+    atEnd();
+    const char *q = p;
+    if (q < reader.end && (*q == '{' || *q == '}')) {
+        q++;
+    } else {
+        while (q < reader.end && !isDelimiter(*q)) { q++; }
+    }
+    Token token;
+    token.text = p;
+    token.length = q - p;
+    return token;
+}
+
+AsciiSceneReader::Token AsciiSceneReader::Cursor::next(){
+    Token token = peek();
+    p = token.text + token.length;
+    return token;
+}
+
+// The rest of the line, as with scanf's %[^\n].
+AsciiSceneReader::Token AsciiSceneReader::Cursor::line(){
+    atEnd();
+    Token token;
+    token.text = p;
+    while (p < reader.end && *p != '\n') { p++; }
+    token.length = p - token.text;
+    return token;
+}
+
+// Optional tokens, like the braces that the fscanf reader skipped when they were missing.
+// Compares in place instead of going through peek(), this is the hot path.
+inline bool AsciiSceneReader::Cursor::accept(const char *word){
+    atEnd();
+    const char *q = p;
+    for (; *word != '\0'; word++, q++) {
+        if (q >= reader.end || *q != *word) { return false; }
+    }
+    if (q < reader.end && !isDelimiter(*q) && q[-1] != '{' && q[-1] != '}') { return false; }
+    p = q;
+    return true;
+}
+
+inline bool AsciiSceneReader::Cursor::expect(const char *keyword){
+    if (accept(keyword)) { return true; }
+    std::string message = std::string("expected '") + keyword + "'";
+    reader.error(p, message.c_str());
+    return false;
+}
+
+// Same values as scanf's %g and %ld, except that the whole token has to be the number.
+template <typename T>
+inline bool AsciiSceneReader::Cursor::number(T &out){
+    const char *first = atEnd() ? p : (*p == '+' ? p + 1 : p);
+    std::from_chars_result result = std::from_chars(first, reader.end, out);
+    if (result.ec != std::errc() || (result.ptr < reader.end && !isDelimiter(*result.ptr))) {
+        reader.error(p, "expected a number");
+        return false;
+    }
+    p = result.ptr;
+    return true;
+}
+
+inline bool AsciiSceneReader::Cursor::number(Flt &out){
+    atEnd();
+    return parseShortDecimal(p, reader.end, out) || number<Flt>(out);
+}
+
+bool AsciiSceneReader::Cursor::floats(const char *keyword, Flt *out, int count){
+    if (!expect(keyword)) { return false; }
+    for (int i = 0; i < count; i++) {
+        if (!number(out[i])) { return false; }
+    }
+    return true;
+}
+
+bool AsciiSceneReader::Cursor::integer(const char *keyword, long &out){
+    return expect(keyword) && number(out);
+}
+
+AsciiSceneReader::AsciiSceneReader(MappedFile &file, const char *filename, const char *begin, const char *end):file(file), filename(filename), begin(begin), end(end){
+}
+
+void AsciiSceneReader::error(const char *near, const char *message) const {
+    if (near >= end) {
+        printf("Error in '%s' at end of file: %s\n", filename, message);
+        return;
+    }
+    long line = 1;
+    for (const char *p = begin; p < near; p++) {
+        if (*p == '\n') { line++; }
+    }
+    const char *last = near;
+    while (last < end && !isBlank(*last) && last - near < 40) { last++; }
+    printf("Error in '%s' line %ld near '%.*s': %s\n", filename, line, (int)(last - near), near, message);
+}
+
+#pragma mark - Scene
+
+SceneIO* AsciiSceneReader::read(const char *filename, long offset, SceneBuilder *builder){
+    MappedFile file;
+    if (!file.open(filename)) {
+        printf("Can't open file '%s' for reading.\n", filename);
+        return NULL;
+    }
+    if (offset < 0 || (size_t)offset > file.size()) {
+        return NULL;
+    }
+    AsciiSceneReader reader(file, filename, (const char *)file.data() + offset, (const char *)file.data() + file.size());
+
+    SceneIO *scene = (SceneIO *)calloc(1, sizeof(SceneIO));
+    SceneIOBuilder sceneBuilder(scene);
+    if (!reader.readScene(scene, builder != NULL ? *builder : sceneBuilder)) {
+        deleteScene(scene);
+        return NULL;
+    }
+    return scene;
+}
+
+bool AsciiSceneReader::readScene(SceneIO *scene, SceneBuilder &builder){
+    Cursor cursor(*this, begin);
+    while (!cursor.atEnd()) {
+        Token word = cursor.next();
+        if (word.equals("camera")) {
+            readCamera(scene, cursor);
+        } else if (word.equals("point_light")) {
+            readLight(scene, cursor, POINT_LIGHT);
+        } else if (word.equals("directional_light")) {
+            readLight(scene, cursor, DIRECTIONAL_LIGHT);
+        } else if (word.equals("spot_light")) {
+            readLight(scene, cursor, SPOT_LIGHT);
+        } else if (word.equals("sphere")) {
+            readSphere(builder, cursor);
+        } else if (word.equals("poly_set")) {
+            if (!readPolySet(builder, cursor)) {
+                return false;
+            }
+        } else {
+            printf("Unrecognized keyword '%.*s', aborting.\n", (int)word.length, word.text);
+            return false;
+        }
+    }
+    return true;
+}
+
+void AsciiSceneReader::readCamera(SceneIO *scene, Cursor &cursor){
+    CameraIO *camera = new_camera();
+    scene->camera = camera;
+
+    cursor.accept("{");
+    cursor.floats("position", camera->position, 3);
+    cursor.floats("viewDirection", camera->viewDirection, 3);
+    cursor.floats("focalDistance", &camera->focalDistance, 1);
+    cursor.floats("orthoUp", camera->orthoUp, 3);
+    cursor.floats("verticalFOV", &camera->verticalFOV, 1);
+    cursor.accept("}");
+}
+
+void AsciiSceneReader::readLight(SceneIO *scene, Cursor &cursor, LightType type){
+    LightIO *light = append_light(&scene->lights);
+    light->type = type;
+
+    cursor.accept("{");
+    if (type != DIRECTIONAL_LIGHT) {
+        cursor.floats("position", light->position, 3);
+    }
+    if (type != POINT_LIGHT) {
+        cursor.floats("direction", light->direction, 3);
+    }
+    cursor.floats("color", light->color, 3);
+    if (type == SPOT_LIGHT) {
+        cursor.floats("dropOffRate", &light->dropOffRate, 1);
+        cursor.floats("cutOffAngle", &light->cutOffAngle, 1);
+    }
+    cursor.accept("}");
+}
+
+void AsciiSceneReader::readObject(ObjectHeader &obj, Cursor &cursor){
+    obj.hasName = false;
+    if (cursor.expect("name")) {
+        Token name = cursor.line();
+        if (name.equals("NULL")) {
+        } else if (name.length < 2 || name.text[0] != '\"' || name.text[name.length - 1] != '\"') {
+            printf("Error in object name format: %.*s\n", (int)name.length, name.text);
+        } else {
+            obj.name.assign(name.text + 1, name.length - 2);
+            obj.hasName = true;
+        }
+    }
+    long materialCount = 0;
+    cursor.integer("numMaterials", materialCount);
+    obj.materials.assign(std::max(materialCount, 0L), MaterialIO());
+    for (MaterialIO &material: obj.materials) {
+        readMaterial(&material, cursor);
+    }
+}
+
+void AsciiSceneReader::readMaterial(MaterialIO *material, Cursor &cursor){
+    cursor.accept("material");
+    cursor.accept("{");
+    cursor.floats("diffColor", material->diffColor, 3);
+    cursor.floats("ambColor", material->ambColor, 3);
+    cursor.floats("specColor", material->specColor, 3);
+    cursor.floats("emisColor", material->emissColor, 3);
+    cursor.floats("shininess", &material->shininess, 1);
+    cursor.floats("ktran", &material->ktran, 1);
+    cursor.accept("}");
+}
+
+void AsciiSceneReader::readSphere(SceneBuilder &builder, Cursor &cursor){
+    ObjectHeader obj;
+    SphereIO sphere;
+    memset(&sphere, 0, sizeof(sphere));
+
+    cursor.accept("{");
+    readObject(obj, cursor);
+    cursor.floats("origin", sphere.origin, 3);
+    cursor.floats("radius", &sphere.radius, 1);
+    cursor.floats("xaxis", sphere.xaxis, 3);
+    cursor.floats("xlength", &sphere.xlength, 1);
+    cursor.floats("yaxis", sphere.yaxis, 3);
+    cursor.floats("ylength", &sphere.ylength, 1);
+    cursor.floats("zaxis", sphere.zaxis, 3);
+    cursor.floats("zlength", &sphere.zlength, 1);
+    cursor.accept("}");
+    builder.sphere(sphere, obj.materialData(), obj.materials.size(), obj.nameData());
+}
+
+#pragma mark - Polysets
+
+bool AsciiSceneReader::readPolySet(SceneBuilder &builder, Cursor &cursor){
+    ObjectHeader obj;
+    PolySetIO header;
+    memset(&header, 0, sizeof(header));
+    PolySetIO *pset = &header;
+
+    cursor.accept("{");
+    readObject(obj, cursor);
+    Token word = cursor.expect("type") ? cursor.next() : Token();
+    if (word.equals("POLYSET_TRI_MESH")) {
+        pset->type = POLYSET_TRI_MESH;
+    } else if (word.equals("POLYSET_FACE_SET")) {
+        pset->type = POLYSET_FACE_SET;
+    } else if (word.equals("POLYSET_QUAD_MESH")) {
+        pset->type = POLYSET_QUAD_MESH;
+    } else {
+        printf("Error: unknown polyset type\n");
+    }
+    word = cursor.expect("normType") ? cursor.next() : Token();
+    if (word.equals("PER_VERTEX_NORMAL")) {
+        pset->normType = PER_VERTEX_NORMAL;
+    } else if (word.equals("PER_FACE_NORMAL")) {
+        pset->normType = PER_FACE_NORMAL;
+    } else {
+        printf("Error: unknown polyset normType\n");
+    }
+    word = cursor.expect("materialBinding") ? cursor.next() : Token();
+    if (word.equals("PER_OBJECT_MATERIAL")) {
+        pset->materialBinding = PER_OBJECT_MATERIAL;
+    } else if (word.equals("PER_VERTEX_MATERIAL")) {
+        pset->materialBinding = PER_VERTEX_MATERIAL;
+    } else {
+        printf("Error: unknown material binding\n");
+    }
+    word = cursor.expect("hasTextureCoords") ? cursor.next() : Token();
+    if (word.equals("TRUE")) {
+        pset->hasTextureCoords = TRUE;
+    } else if (word.equals("FALSE")) {
+        pset->hasTextureCoords = FALSE;
+    } else {
+        printf("Error: unknown hasTextureCoords field\n");
+    }
+    cursor.integer("rowSize", pset->rowSize);
+    if (!cursor.integer("numPolys", pset->numPolys) || pset->numPolys < 0) {
+        pset->numPolys = 0;
+        return false;
+    }
+    builder.beginPolySet(header, obj.materialData(), obj.materials.size(), obj.nameData());
+
+    // Polygons are parsed a batch at a time and handed to the builder, so at most
+    // threadCount * PARSE_CHUNK_POLYS of them are held here at once.
+    long chunks = (pset->numPolys + PARSE_CHUNK_POLYS - 1) / PARSE_CHUNK_POLYS;
+    long threadCount = std::min<long>(chunks, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<PolygonChunk> batch(std::max(threadCount, 1L));
+    std::vector<const char *> starts;
+    std::vector<const char *> ends(batch.size());
+    static const char keyword[] = "numVertices";
+    std::boyer_moore_horspool_searcher<const char *> searcher(keyword, keyword + sizeof(keyword) - 1);
+    const char *q = cursor.p;
+
+    for (long first = 0; first < pset->numPolys; first += threadCount * PARSE_CHUNK_POLYS) {
+        long last = std::min(pset->numPolys, first + threadCount * PARSE_CHUNK_POLYS);
+        if (threadCount <= 1) {
+            cursor.p = readPolygons(pset, NULL, last - first, cursor.p, batch[0]);
+        } else {
+            // Index pass: vertex data never contains "numVertices", so a substring search
+            // finds where each polygon starts without tokenizing everything twice.
+            starts.resize(last - first);
+            for (long i = first; i < last; i++) {
+                q = std::search(q, end, searcher);
+                if (q == end) {
+                    error(end, "expected 'numVertices'");
+                    builder.abortPolySet();
+                    return false;
+                }
+                starts[i - first] = q;
+                q += sizeof(keyword) - 1;
+            }
+
+            std::vector<std::thread> threads;
+            for (long t = 0; t < threadCount; t++) {
+                long from = std::min(last - first, t * PARSE_CHUNK_POLYS);
+                long to = std::min(last - first, (t + 1) * PARSE_CHUNK_POLYS);
+                batch[t].clear();
+                ends[t] = NULL;
+                if (from == to) { continue; }
+                threads.push_back(std::thread([this, pset, &starts, &batch, &ends, t, from, to]{
+                    ends[t] = readPolygons(pset, &starts[from], to - from, starts[from], batch[t]);
+                }));
+            }
+            for (std::thread &thread: threads) {
+                thread.join();
+            }
+            cursor.p = ends[threads.size() - 1];
+        }
+        for (const PolygonChunk &chunk: batch) {
+            const VertexIO *vertices = chunk.vertices.empty() ? NULL : &chunk.vertices[0];
+            for (long count: chunk.counts) {
+                builder.polygon(vertices, count);
+                vertices += count;
+            }
+        }
+        // The text of a large polyset would otherwise stay resident next to the meshes built from it.
+        file.release(cursor.p - (const char *)file.data());
+    }
+    builder.endPolySet();
+    cursor.accept("}");
+    return true;
+}
+
+// Parses `count` polygons into `chunk` and returns the position after the last one.
+// With `starts`, each polygon is parsed from its own "numVertices" keyword.
+const char* AsciiSceneReader::readPolygons(const PolySetIO *pset, const char *const *starts, long count, const char *p, PolygonChunk &chunk) const {
+    PROFILE_SCOPE_VALUE("parse polygons", count);
+    Cursor cursor(*this, p);
+    chunk.clear();
+    for (long i = 0; i < count; i++) {
+        if (starts != NULL) {
+            cursor.p = starts[i];
+        }
+        cursor.accept("poly");
+        cursor.accept("{");
+        long numVertices;
+        if (!cursor.integer("numVertices", numVertices) || numVertices < 0) {
+            numVertices = 0;
+        }
+        size_t first = chunk.vertices.size();
+        chunk.vertices.resize(first + numVertices);
+        chunk.counts.push_back(numVertices);
+        VertexIO *vert = chunk.vertices.empty() ? NULL : &chunk.vertices[first];
+        for (long j = 0; j < numVertices; j++, vert++) {
+            cursor.floats("pos", vert->pos, 3);
+            if (pset->normType == PER_VERTEX_NORMAL) {
+                cursor.floats("norm", vert->norm, 3);
+            }
+            if (pset->materialBinding == PER_VERTEX_MATERIAL) {
+                cursor.integer("materialIndex", vert->materialIndex);
+            }
+            if (pset->hasTextureCoords) {
+                cursor.floats("s", &vert->s, 1);
+                cursor.floats("t", &vert->t, 1);
+            }
+        }
+        cursor.accept("}");
+    }
+    return cursor.p;
+}
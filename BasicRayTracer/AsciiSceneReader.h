@@ -0,0 +1,93 @@
+//
+//  AsciiSceneReader.h
+//  BasicRayTracer
+//
+//  Reader for the Composer 2.1 ascii format that replaces the fscanf based
+//  readSceneA. The file is mapped and tokenized in a single pass over the
+//  buffer; numbers are converted in place with std::from_chars, which ignores
+//  the locale. Large polysets are indexed by their "numVertices" keywords and
+//  the polygons parsed in chunks on several threads. Objects go to a
+//  SceneBuilder as they are parsed; without one, the SceneIO it returns is
+//  identical to readSceneA's, including tolerance for missing braces, and is
+//  released with deleteScene().
+//
+
+#ifndef __BasicRayTracer__AsciiSceneReader__
+#define __BasicRayTracer__AsciiSceneReader__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "scene_io.h"
+#include "SceneBuilder.h"
+#include "MappedFile.h"
+
+#define PARSE_CHUNK_POLYS 4096
+
+class AsciiSceneReader {
+private:
+    struct Token {
+        const char *text;
+        size_t length;
+        Token():text(""), length(0){};
+        bool equals(const char *word) const;
+    };
+
+    // Reads tokens straight out of the buffer. Each parsing thread has its own.
+    struct Cursor {
+        const AsciiSceneReader &reader;
+        const char *p;
+        Cursor(const AsciiSceneReader &reader, const char *p):reader(reader), p(p){};
+
+        bool atEnd();
+        Token peek();
+        Token next();
+        Token line();
+        bool accept(const char *word);
+        bool expect(const char *keyword);
+        bool floats(const char *keyword, Flt *out, int count);
+        bool integer(const char *keyword, long &out);
+        template <typename T> bool number(T &out);
+        bool number(Flt &out);
+    };
+
+    // Name and materials of the object being read.
+    struct ObjectHeader {
+        std::string name;
+        bool hasName;
+        std::vector<MaterialIO> materials;
+        ObjectHeader():hasName(false){};
+        const char* nameData() const { return hasName ? name.c_str() : NULL; }
+        const MaterialIO* materialData() const { return materials.empty() ? NULL : &materials[0]; }
+    };
+
+    // Parsed polygons on their way to the builder: the vertices back to back and each polygon's count.
+    struct PolygonChunk {
+        std::vector<VertexIO> vertices;
+        std::vector<long> counts;
+        void clear(){ vertices.clear(); counts.clear(); }
+    };
+
+    MappedFile &file;
+    const char *filename;
+    const char *begin;
+    const char *end;
+
+    AsciiSceneReader(MappedFile &file, const char *filename, const char *begin, const char *end);
+    void error(const char *near, const char *message) const;
+
+    bool readScene(SceneIO *scene, SceneBuilder &builder);
+    void readCamera(SceneIO *scene, Cursor &cursor);
+    void readLight(SceneIO *scene, Cursor &cursor, LightType type);
+    void readObject(ObjectHeader &obj, Cursor &cursor);
+    void readMaterial(MaterialIO *material, Cursor &cursor);
+    void readSphere(SceneBuilder &builder, Cursor &cursor);
+    bool readPolySet(SceneBuilder &builder, Cursor &cursor);
+    const char* readPolygons(const PolySetIO *pset, const char *const *starts, long count, const char *p, PolygonChunk &chunk) const;
+public:
+    // Parse `filename` from byte `offset`, just past the "Composer format" header.
+    // With a builder, the returned scene only holds the camera and lights.
+    static SceneIO* read(const char *filename, long offset, SceneBuilder *builder = NULL);
+};
+
+#endif /* defined(__BasicRayTracer__AsciiSceneReader__) */
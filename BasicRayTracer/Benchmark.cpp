@@ -0,0 +1,271 @@
+//
+//  Benchmark.cpp
+//  BasicRayTracer
+//
+
+#include "Benchmark.h"
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "Timer.h"
+#include "Mesh.h"
+#include "Sphere.h"
+#include "PhotonMap.h"
+#include "SceneBuilder.h"
+
+namespace {
+
+struct BenchmarkResult {
+    std::string name;
+    std::string subject;    // What the kernel ran on
+    long ops;
+    double seconds;         // Fastest repeat
+    bool rays;              // Ops are rays, so ops/sec is reported as rays/sec
+};
+
+/* The scene's meshes and spheres without materials: no kernel here shades. */
+class BenchmarkSceneBuilder : public SceneBuilder {
+private:
+    Mesh *mesh;
+public:
+    std::vector<Mesh*> meshes;
+    std::vector<SphereIO> spheres;
+
+    BenchmarkSceneBuilder():mesh(NULL){};
+    ~BenchmarkSceneBuilder(){
+        for (Mesh *m: meshes) {
+            delete m;
+        }
+    }
+
+    virtual void sphere(const SphereIO &sphere, const MaterialIO *, long, const char *) {
+        spheres.push_back(sphere);
+    }
+    virtual void beginPolySet(const PolySetIO &polySet, const MaterialIO *, long materialCount, const char *) {
+        mesh = new Mesh(polySet.normType, polySet.materialBinding, polySet.hasTextureCoords, 0, materialCount, NULL);
+    }
+    virtual void polygon(const VertexIO *vertices, long vertexCount) {
+        mesh->addPolygon(vertices, vertexCount);
+    }
+    virtual void endPolySet() {
+        mesh->finish();
+        meshes.push_back(mesh);
+        mesh = NULL;
+    }
+    virtual void abortPolySet() {
+        delete mesh;
+        mesh = NULL;
+    }
+};
+
+// Results are added up here so the compiler can't drop the calls being timed.
+volatile long sink;
+
+template <typename Kernel>
+double fastest(Kernel kernel){
+    double best = INFINITY;
+    for (int r = 0; r < BENCHMARK_REPEATS; r++) {
+        Timer timer;
+        timer.start();
+        kernel();
+        timer.stop();
+        best = fmin(best, timer.getElapsedTimeInSec());
+    }
+    return best;
+}
+
+Vec3f uniformIn(const Vec3f &lo, const Vec3f &hi, std::mt19937 &rng){
+    std::uniform_real_distribution<float> unit(0, 1);
+    float x = unit(rng), y = unit(rng), z = unit(rng);
+    return Vec3f(lo.x + (hi.x - lo.x) * x, lo.y + (hi.y - lo.y) * y, lo.z + (hi.z - lo.z) * z);
+}
+
+/* Rays from a shell around the box, each aimed at a random point inside it. */
+std::vector<Ray> raysAt(const Vec3f &lo, const Vec3f &hi, const long count, std::mt19937 &rng){
+    std::normal_distribution<float> normal(0, 1);
+    Vec3f center = (lo + hi) * 0.5;
+    float radius = fmax((hi - lo).length(), 1e-3f) * 1.5;
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (long i = 0; i < count; i++) {
+        Vec3f away = Vec3f(normal(rng), normal(rng), normal(rng)).normalize();
+        Pos origin = center + away * radius;
+        rays.push_back(Ray(origin, uniformIn(lo, hi, rng) - origin));
+    }
+    return rays;
+}
+
+std::string describe(const Mesh &mesh, const size_t index){
+    return "mesh " + std::to_string(index) + " (" + std::to_string(mesh.triangleCount) + " triangles)";
+}
+
+std::string escaped(const char *text){
+    std::string out;
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+        }
+        out += *c;
+    }
+    return out;
+}
+
+void writeJSON(FILE *out, const char *sceneFile, const std::vector<BenchmarkResult> &results){
+    fprintf(out, "{\n  \"scene\": \"%s\",\n  \"repeats\": %d,\n  \"seed\": %d,\n  \"benchmarks\": [\n", escaped(sceneFile).c_str(), BENCHMARK_REPEATS, BENCHMARK_SEED);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult &r = results[i];
+        double perSecond = r.seconds > 0 ? r.ops / r.seconds : 0;
+        fprintf(out, "    {\"name\": \"%s\", \"subject\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.3f, \"%s\": %.0f}%s\n",
+                r.name.c_str(), r.subject.c_str(), r.ops, r.seconds * 1e9 / r.ops,
+                r.rays ? "rays_per_sec" : "ops_per_sec", perSecond, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+}
+
+bool Benchmark::run(const char *sceneFile, FILE *out){
+    BenchmarkSceneBuilder builder;
+    SceneIO *scene = streamScene(sceneFile, &builder);
+    if (scene == NULL) {
+        return false;
+    }
+    deleteScene(scene);
+
+    std::vector<BenchmarkResult> results;
+    std::mt19937 rng(BENCHMARK_SEED);
+    Mesh *largest = NULL;
+    size_t largestIndex = 0;
+    for (size_t m = 0; m < builder.meshes.size(); m++) {
+        if (largest == NULL || builder.meshes[m]->triangleCount > largest->triangleCount) {
+            largest = builder.meshes[m];
+            largestIndex = m;
+        }
+    }
+
+    if (largest != NULL && largest->triangleCount > 0) {
+        // One ray per triangle, aimed into its bounds, so a fair share of the tests hit.
+        std::vector<Ray> rays;
+        rays.reserve(BENCHMARK_RAYS);
+        for (long i = 0; i < BENCHMARK_RAYS; i++) {
+            const Box &box = largest->triangles[i % largest->triangleCount]->bounds;
+            std::vector<Ray> one = raysAt(box.min, box.max, 1, rng);
+            rays.push_back(one[0]);
+        }
+        double seconds = fastest([&]{
+            long hits = 0;
+            for (long i = 0; i < BENCHMARK_INTERSECTIONS; i++) {
+                Ray &ray = rays[i % BENCHMARK_RAYS];
+                ray.t_max = INFINITY;
+                hits += largest->triangles[(i % BENCHMARK_RAYS) % largest->triangleCount]->intersect(ray);
+            }
+            sink += hits;
+        });
+        results.push_back(BenchmarkResult{"Triangle::intersect", describe(*largest, largestIndex), BENCHMARK_INTERSECTIONS, seconds, true});
+    }
+
+    {
+        SphereIO data;
+        if (!builder.spheres.empty()) {
+            data = builder.spheres[0];
+        } else {
+            SphereIO unit = { {0, 0, 0}, 1, {1, 0, 0}, 1, {0, 1, 0}, 1, {0, 0, 1}, 1 };
+            data = unit;
+        }
+        Sphere sphere(data, 0, NULL);
+        std::vector<Ray> rays = raysAt(sphere.bounds[0], sphere.bounds[1], BENCHMARK_RAYS, rng);
+        double seconds = fastest([&]{
+            long hits = 0;
+            for (long i = 0; i < BENCHMARK_INTERSECTIONS; i++) {
+                Ray &ray = rays[i % BENCHMARK_RAYS];
+                ray.t_max = INFINITY;
+                hits += sphere.intersect(ray);
+            }
+            sink += hits;
+        });
+        results.push_back(BenchmarkResult{"Sphere::intersect", builder.spheres.empty() ? "unit sphere" : "sphere 0", BENCHMARK_INTERSECTIONS, seconds, true});
+    }
+
+    for (size_t m = 0; m < builder.meshes.size(); m++) {
+        Mesh *mesh = builder.meshes[m];
+        if (mesh->triangleCount == 0) {
+            continue;
+        }
+        std::vector<Ray> rays = raysAt(mesh->bounds[0], mesh->bounds[1], BENCHMARK_RAYS, rng);
+        if (mesh == largest) {
+            Box box = Box(mesh->bounds[0], mesh->bounds[1]);
+            double seconds = fastest([&]{
+                float sum = 0;
+                for (long i = 0; i < BENCHMARK_INTERSECTIONS; i++) {
+                    sum += box.intersect(rays[i % BENCHMARK_RAYS]).first;
+                }
+                sink += (long)sum;
+            });
+            results.push_back(BenchmarkResult{"Box::intersect", describe(*mesh, m), BENCHMARK_INTERSECTIONS, seconds, true});
+        }
+        double seconds = fastest([&]{
+            long hits = 0;
+            for (Ray &ray: rays) {
+                ray.t_max = INFINITY;
+                mesh->tree->traverse(ray);
+                hits += ray.t_max < INFINITY;
+            }
+            sink += hits;
+        });
+        results.push_back(BenchmarkResult{"Node::traverse", describe(*mesh, m), BENCHMARK_RAYS, seconds, true});
+
+        // Straight SAH builds, past the kd-tree cache.
+        seconds = fastest([&]{
+            Node *root = Node().RecBuild(mesh->triangles, Box(mesh->bounds[0], mesh->bounds[1]), 0, SplitPlane());
+            delete root;
+        });
+        results.push_back(BenchmarkResult{"Node::RecBuild", describe(*mesh, m), 1, seconds, false});
+    }
+
+    // Photons spread over the scene's bounds, with the same count and queries every run.
+    Vec3f lo = Vec3f(INFINITY, INFINITY, INFINITY), hi = Vec3f(-INFINITY, -INFINITY, -INFINITY);
+    for (Mesh *mesh: builder.meshes) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = fmin(lo[axis], mesh->bounds[0][axis]);
+            hi[axis] = fmax(hi[axis], mesh->bounds[1][axis]);
+        }
+    }
+    if (builder.meshes.empty()) {
+        lo = Vec3f(-1, -1, -1);
+        hi = Vec3f(1, 1, 1);
+    }
+    std::vector<Photon> photons;
+    photons.reserve(BENCHMARK_PHOTONS);
+    for (long i = 0; i < BENCHMARK_PHOTONS; i++) {
+        photons.push_back(Photon(uniformIn(lo, hi, rng), Vec3f(0, -1, 0), Colr(1, 1, 1)));
+    }
+    PhotonMap photonMap;
+    double seconds = fastest([&]{
+        photonMap = PhotonMap();
+        for (const Photon &photon: photons) {
+            photonMap.store(photon);
+        }
+        photonMap.build();
+    });
+    results.push_back(BenchmarkResult{"PhotonMap::build", std::to_string(BENCHMARK_PHOTONS) + " photons", 1, seconds, false});
+
+    std::vector<Pos> queries;
+    for (long i = 0; i < BENCHMARK_QUERIES; i++) {
+        queries.push_back(uniformIn(lo, hi, rng));
+    }
+    const int neighbours[] = { 1, 10, 50, 100 };
+    for (int k: neighbours) {
+        seconds = fastest([&]{
+            size_t found = 0;
+            for (const Pos &query: queries) {
+                found += photonMap.kNN(query, k).size();
+            }
+            sink += found;
+        });
+        results.push_back(BenchmarkResult{"PhotonMap::kNN", "k = " + std::to_string(k), BENCHMARK_QUERIES, seconds, false});
+    }
+
+    writeJSON(out, sceneFile, results);
+    return true;
+}
@@ -0,0 +1,32 @@
+//
+//  Benchmark.h
+//  BasicRayTracer
+//
+//  Microbenchmarks for the kernels a render spends its time in: ray/triangle,
+//  ray/sphere and ray/box tests, kd-tree traversal and construction, and the
+//  photon map's build and k-nearest-neighbour queries. Meshes and spheres come
+//  from a scene file; rays and photons from a fixed seed, so runs compare.
+//
+//  Every kernel is timed BENCHMARK_REPEATS times and the fastest run is reported
+//  as JSON, with ns/op and ops/sec (rays/sec for the kernels that trace rays).
+//
+
+#ifndef __BasicRayTracer__Benchmark__
+#define __BasicRayTracer__Benchmark__
+
+#include <stdio.h>
+
+#define BENCHMARK_REPEATS 5
+#define BENCHMARK_RAYS 100000           // Fixed rays per mesh
+#define BENCHMARK_INTERSECTIONS 2000000 // Calls per run of the single-primitive tests
+#define BENCHMARK_PHOTONS 200000
+#define BENCHMARK_QUERIES 20000         // kNN lookups per run
+#define BENCHMARK_SEED 12345
+
+class Benchmark {
+public:
+    // Runs every kernel on the objects in `sceneFile` and writes the results to `out`.
+    static bool run(const char *sceneFile, FILE *out);
+};
+
+#endif /* defined(__BasicRayTracer__Benchmark__) */
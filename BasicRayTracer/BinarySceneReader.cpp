@@ -0,0 +1,289 @@
+//
+//  BinarySceneReader.cpp
+//  BasicRayTracer
+//
+
+#include "BinarySceneReader.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#define MATERIAL_RECORD_SIZE (14 * sizeof(Flt))
+#define SPHERE_RECORD_SIZE (16 * sizeof(Flt))
+
+BinarySceneReader::BinarySceneReader(MappedFile &file, const char *filename, size_t offset, double version):file(file), filename(filename), p(file.data() + offset), end(file.data() + file.size()), version(version), longSize(sizeof(long)){
+}
+
+bool BinarySceneReader::error(const char *message){
+    printf("Error in '%s' at byte %ld: %s\n", filename, (long)(p - file.data()), message);
+    return false;
+}
+
+#pragma mark - Fields
+
+// The 2.1 header holds a long and a float written by the exporting machine. Both
+// widths of long are accepted; a different byte order or float format is not.
+bool BinarySceneReader::detectLongSize(){
+    if (version < 2.1) {
+        return true;
+    }
+    int32_t long4;
+    int64_t long8;
+    Flt flt;
+    if (end - p >= 8) {
+        memcpy(&long4, p, 4);
+        memcpy(&flt, p + 4, sizeof(Flt));
+        if (long4 == BINARY_SCENE_TEST_LONG && flt == BINARY_SCENE_TEST_FLT) {
+            longSize = 4;
+            p += 8;
+            return true;
+        }
+    }
+    if (end - p >= 12) {
+        memcpy(&long8, p, 8);
+        memcpy(&flt, p + 8, sizeof(Flt));
+        if (long8 == BINARY_SCENE_TEST_LONG && flt == BINARY_SCENE_TEST_FLT) {
+            longSize = 8;
+            p += 12;
+            return true;
+        }
+    }
+    printf("Binary format was written on a different architecture!\n");
+    return false;
+}
+
+inline bool BinarySceneReader::bytes(void *out, size_t size){
+    if ((size_t)(end - p) < size) {
+        return error("unexpected end of file");
+    }
+    memcpy(out, p, size);
+    p += size;
+    return true;
+}
+
+inline bool BinarySceneReader::integer(long &out){
+    if (longSize == 4) {
+        int32_t value;
+        if (!bytes(&value, 4)) { return false; }
+        out = value;
+    } else {
+        int64_t value;
+        if (!bytes(&value, 8)) { return false; }
+        out = (long)value;
+    }
+    return true;
+}
+
+inline bool BinarySceneReader::integer(int &out){
+    int32_t value;
+    if (!bytes(&value, 4)) { return false; }
+    out = value;
+    return true;
+}
+
+#pragma mark - Scene
+
+SceneIO* BinarySceneReader::read(const char *filename, long offset, double version, SceneBuilder *builder){
+    MappedFile file;
+    if (!file.open(filename)) {
+        printf("Can't open file '%s' for reading.\n", filename);
+        return NULL;
+    }
+    if (offset < 0 || (size_t)offset > file.size()) {
+        return NULL;
+    }
+    BinarySceneReader reader(file, filename, offset, version);
+
+    SceneIO *scene = (SceneIO *)calloc(1, sizeof(SceneIO));
+    SceneIOBuilder sceneBuilder(scene);
+    if (!reader.readScene(scene, builder != NULL ? *builder : sceneBuilder)) {
+        deleteScene(scene);
+        return NULL;
+    }
+    return scene;
+}
+
+bool BinarySceneReader::readScene(SceneIO *scene, SceneBuilder &builder){
+    if (!detectLongSize() || !readCamera(scene) || !readLights(scene)) {
+        return false;
+    }
+    long objectCount;
+    if (!integer(objectCount)) {
+        return false;
+    }
+    for (long i = 0; i < objectCount; i++) {
+        if (!readObject(builder)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BinarySceneReader::readCamera(SceneIO *scene){
+    CameraIO *camera = new_camera();
+    scene->camera = camera;
+    if (!bytes(camera->position, sizeof(Point))
+        || !bytes(camera->viewDirection, sizeof(Vec))
+        || !bytes(&camera->focalDistance, sizeof(Flt))
+        || !bytes(camera->orthoUp, sizeof(Vec))
+        || !bytes(&camera->verticalFOV, sizeof(Flt))) {
+        return false;
+    }
+    if (camera->verticalFOV == 0.0) {
+        // writeSceneBinary writes a missing camera as zeros.
+        free(camera);
+        scene->camera = NULL;
+    }
+    return true;
+}
+
+bool BinarySceneReader::readLights(SceneIO *scene){
+    long lightCount;
+    if (!integer(lightCount)) {
+        return false;
+    }
+    for (long i = 0; i < lightCount; i++) {
+        LightIO *light = append_light(&scene->lights);
+        int type;
+        if (!integer(type)
+            || !bytes(light->position, sizeof(Point))
+            || !bytes(light->direction, sizeof(Vec))
+            || !bytes(light->color, sizeof(Color))
+            || !bytes(&light->dropOffRate, sizeof(Flt))
+            || !bytes(&light->cutOffAngle, sizeof(Flt))) {
+            return false;
+        }
+        light->type = (LightType)type;
+    }
+    return true;
+}
+
+bool BinarySceneReader::readObject(SceneBuilder &builder){
+    int type;
+    long nameLength;
+    if (!integer(type) || !integer(nameLength)) {
+        return false;
+    }
+    std::string name;
+    if (nameLength != -1) {
+        // Stored with its terminating NUL.
+        if (nameLength < 0 || end - p <= nameLength) {
+            return error("bad object name length");
+        }
+        name.assign((const char *)p, strnlen((const char *)p, nameLength));
+        p += nameLength + 1;
+    }
+    long materialCount = 1;
+    if (version > 2.0 && !integer(materialCount)) {
+        return false;
+    }
+    // The records have MaterialIO's layout, so the whole table is copied at once.
+    static_assert(sizeof(MaterialIO) == MATERIAL_RECORD_SIZE, "MaterialIO is not 14 packed floats");
+    if (materialCount < 0 || (size_t)(end - p) / MATERIAL_RECORD_SIZE < (size_t)materialCount) {
+        return error("bad material count");
+    }
+    std::vector<MaterialIO> materials(materialCount);
+    if (materialCount > 0) {
+        memcpy(&materials[0], p, materialCount * MATERIAL_RECORD_SIZE);
+        p += materialCount * MATERIAL_RECORD_SIZE;
+    }
+    const MaterialIO *material = materials.empty() ? NULL : &materials[0];
+    const char *objectName = nameLength != -1 ? name.c_str() : NULL;
+
+    if (type == SPHERE_OBJ) {
+        static_assert(sizeof(SphereIO) == SPHERE_RECORD_SIZE, "SphereIO is not 16 packed floats");
+        SphereIO sphere;
+        if (!bytes(&sphere, SPHERE_RECORD_SIZE)) {
+            return false;
+        }
+        builder.sphere(sphere, material, materialCount, objectName);
+        return true;
+    }
+    if (type == POLYSET_OBJ) {
+        return readPolySet(builder, material, materialCount, objectName);
+    }
+    return error("unrecognized object type");
+}
+
+#pragma mark - Polysets
+
+bool BinarySceneReader::readPolySet(SceneBuilder &builder, const MaterialIO *materials, long materialCount, const char *name){
+    PolySetIO pset;
+    memset(&pset, 0, sizeof(pset));
+    int type, materialBinding = PER_OBJECT_MATERIAL;
+    long normType;
+    if (!integer(type) || !integer(normType)) {
+        return false;
+    }
+    if (version > 2.0 && (!integer(materialBinding) || !integer(pset.hasTextureCoords))) {
+        return false;
+    }
+    if (!integer(pset.rowSize) || !integer(pset.numPolys)) {
+        return false;
+    }
+    pset.type = (PolySetType)type;
+    pset.normType = (NormType)normType;
+    pset.materialBinding = (MaterialBinding)materialBinding;
+
+    // Every vertex record in the polyset has the same size, so each polygon is
+    // bounds checked once and then copied field by field without further tests.
+    const bool normals = pset.normType == PER_VERTEX_NORMAL;
+    const bool perVertexMaterial = pset.materialBinding == PER_VERTEX_MATERIAL;
+    const bool texCoords = pset.hasTextureCoords != FALSE;
+    const size_t stride = sizeof(Point) + (normals ? sizeof(Vec) : 0) + (perVertexMaterial ? longSize : 0) + (texCoords ? 2 * sizeof(Flt) : 0);
+    if (pset.numPolys < 0 || (size_t)(end - p) / longSize < (size_t)pset.numPolys) {
+        return error("bad polygon count");
+    }
+
+    builder.beginPolySet(pset, materials, materialCount, name);
+    // Fields the polyset doesn't store are zero, as with readSceneB's calloc.
+    vertices.assign(vertices.size(), VertexIO());
+    for (long i = 0; i < pset.numPolys; i++) {
+        long vertexCount;
+        if (!integer(vertexCount)) {
+            builder.abortPolySet();
+            return false;
+        }
+        if (vertexCount < 0 || (size_t)(end - p) / stride < (size_t)vertexCount) {
+            builder.abortPolySet();
+            return error("bad vertex count");
+        }
+        if ((size_t)vertexCount > vertices.size()) {
+            vertices.resize(vertexCount);
+        }
+        for (long j = 0; j < vertexCount; j++) {
+            VertexIO &vertex = vertices[j];
+            memcpy(vertex.pos, p, sizeof(Point));
+            p += sizeof(Point);
+            if (normals) {
+                memcpy(vertex.norm, p, sizeof(Vec));
+                p += sizeof(Vec);
+            }
+            if (perVertexMaterial) {
+                if (longSize == 4) {
+                    int32_t index;
+                    memcpy(&index, p, 4);
+                    vertex.materialIndex = index;
+                } else {
+                    int64_t index;
+                    memcpy(&index, p, 8);
+                    vertex.materialIndex = (long)index;
+                }
+                p += longSize;
+            }
+            if (texCoords) {
+                memcpy(&vertex.s, p, sizeof(Flt));
+                memcpy(&vertex.t, p + sizeof(Flt), sizeof(Flt));
+                p += 2 * sizeof(Flt);
+            }
+        }
+        builder.polygon(vertexCount > 0 ? &vertices[0] : NULL, vertexCount);
+        if (i % BINARY_RELEASE_POLYS == BINARY_RELEASE_POLYS - 1) {
+            file.release(p - file.data());
+        }
+    }
+    builder.endPolySet();
+    file.release(p - file.data());
+    return true;
+}
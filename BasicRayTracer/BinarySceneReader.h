@@ -0,0 +1,59 @@
+//
+//  BinarySceneReader.h
+//  BasicRayTracer
+//
+//  Reader for Composer binary scenes that replaces readSceneB's field-by-field
+//  freads. The file is mapped and decoded straight out of the buffer: each
+//  polygon is bounds checked once and its vertices copied with fixed-size
+//  memcpys into a reused buffer, then handed to a SceneBuilder.
+//
+//  The format stores C longs, so its layout depends on the machine that wrote
+//  it. The 2.1 header's test long and float tell which: files with 4-byte longs
+//  (like Scenes2/*.scene) load on 64-bit hosts as well, where readSceneB would
+//  reject them. Version 2.0 files have no test values and are read with the
+//  host's long, as before.
+//
+
+#ifndef __BasicRayTracer__BinarySceneReader__
+#define __BasicRayTracer__BinarySceneReader__
+
+#include <stddef.h>
+#include <vector>
+#include "scene_io.h"
+#include "SceneBuilder.h"
+#include "MappedFile.h"
+
+#define BINARY_SCENE_TEST_LONG 123456789
+#define BINARY_SCENE_TEST_FLT 3.1415926f
+#define BINARY_RELEASE_POLYS 4096
+
+class BinarySceneReader {
+private:
+    MappedFile &file;
+    const char *filename;
+    const unsigned char *p;
+    const unsigned char *end;
+    double version;
+    size_t longSize;        // Width of a C long in the file, 4 or 8
+    std::vector<VertexIO> vertices;
+
+    BinarySceneReader(MappedFile &file, const char *filename, size_t offset, double version);
+    bool error(const char *message);
+
+    bool detectLongSize();
+    bool bytes(void *out, size_t size);
+    bool integer(long &out);
+    bool integer(int &out);
+
+    bool readScene(SceneIO *scene, SceneBuilder &builder);
+    bool readCamera(SceneIO *scene);
+    bool readLights(SceneIO *scene);
+    bool readObject(SceneBuilder &builder);
+    bool readPolySet(SceneBuilder &builder, const MaterialIO *materials, long materialCount, const char *name);
+public:
+    // Parse `filename` from byte `offset`, just past the "Composer format" header line.
+    // With a builder, the returned scene only holds the camera and lights.
+    static SceneIO* read(const char *filename, long offset, double version, SceneBuilder *builder = NULL);
+};
+
+#endif /* defined(__BasicRayTracer__BinarySceneReader__) */
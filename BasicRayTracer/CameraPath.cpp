@@ -0,0 +1,85 @@
+//
+//  CameraPath.cpp
+//  BasicRayTracer
+//
+
+#include "CameraPath.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+bool CameraPath::load(const char *filename){
+    std::ifstream file(filename);
+    if (!file) {
+        printf("Can't open camera path '%s'.\n", filename);
+        return false;
+    }
+    keys.clear();
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        Key key;
+        if (!(stream >> key.frame)) {
+            continue;
+        }
+        CameraIO &camera = key.camera;
+        camera.focalDistance = 0;
+        std::string rest;
+        if (!(stream >> camera.position[0] >> camera.position[1] >> camera.position[2]
+              >> camera.viewDirection[0] >> camera.viewDirection[1] >> camera.viewDirection[2]
+              >> camera.orthoUp[0] >> camera.orthoUp[1] >> camera.orthoUp[2]
+              >> camera.verticalFOV) || (stream >> rest) || key.frame < 0) {
+            printf("Error in camera path '%s' at line %d: expected frame, position, view direction, up vector and vertical FOV.\n", filename, lineNumber);
+            keys.clear();
+            return false;
+        }
+        keys.push_back(key);
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b){ return a.frame < b.frame; });
+    if (keys.empty()) {
+        printf("Camera path '%s' has no keys.\n", filename);
+        return false;
+    }
+    return true;
+}
+
+static void lerp(const float *a, const float *b, const float t, float *out, const bool normalize){
+    float length = 0;
+    for (int i = 0; i < 3; i++) {
+        out[i] = a[i] + (b[i] - a[i]) * t;
+        length += out[i] * out[i];
+    }
+    if (normalize && length > 0) {
+        length = sqrtf(length);
+        for (int i = 0; i < 3; i++) {
+            out[i] /= length;
+        }
+    }
+}
+
+CameraIO CameraPath::cameraAt(const int frame, const CameraIO &base) const {
+    CameraIO camera = base;
+    if (keys.empty()) {
+        return camera;
+    }
+    // The first key after `frame`; the one before it is the other end of the span.
+    size_t next = 0;
+    while (next < keys.size() && keys[next].frame <= frame) {
+        next++;
+    }
+    const CameraIO &a = keys[next == 0 ? 0 : next - 1].camera;
+    const CameraIO &b = keys[next == keys.size() ? next - 1 : next].camera;
+    float t = 0;
+    if (next > 0 && next < keys.size()) {
+        t = (float)(frame - keys[next - 1].frame) / (keys[next].frame - keys[next - 1].frame);
+    }
+    lerp(a.position, b.position, t, camera.position, false);
+    lerp(a.viewDirection, b.viewDirection, t, camera.viewDirection, true);
+    lerp(a.orthoUp, b.orthoUp, t, camera.orthoUp, true);
+    camera.verticalFOV = a.verticalFOV + (b.verticalFOV - a.verticalFOV) * t;
+    return camera;
+}
@@ -0,0 +1,39 @@
+//
+//  CameraPath.h
+//  BasicRayTracer
+//
+//  Keyframed camera for rendering a sequence. A path file has one key per line:
+//
+//      # frame  position     view direction  up      vertical FOV
+//      0        0 0 -4       0 0 1           0 1 0   0.714
+//      150      0.6 0.2 -3   -0.2 -0.05 1    0 1 0   0.714
+//      299      0 0 -2.5     0 0 1           0 1 0   0.9
+//
+//  Keys are sorted by frame. Frames between two keys interpolate them linearly,
+//  with the directions renormalized; frames outside the keys hold the nearest one.
+//  Text after a '#' is ignored.
+//
+
+#ifndef __BasicRayTracer__CameraPath__
+#define __BasicRayTracer__CameraPath__
+
+#include <vector>
+#include "scene_io.h"
+
+class CameraPath {
+private:
+    struct Key {
+        int frame;
+        CameraIO camera;
+    };
+    std::vector<Key> keys;
+public:
+    bool load(const char *filename);
+    bool empty() const { return keys.empty(); }
+    // Frames 0 up to the last key.
+    int frameCount() const { return keys.empty() ? 0 : keys.back().frame + 1; }
+    // The camera for `frame`. The focal distance, which keys don't set, is `base`'s.
+    CameraIO cameraAt(const int frame, const CameraIO &base) const;
+};
+
+#endif /* defined(__BasicRayTracer__CameraPath__) */
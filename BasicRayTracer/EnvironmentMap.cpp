@@ -0,0 +1,94 @@
+//
+//  EnvironmentMap.cpp
+//  BasicRayTracer
+//
+//  Importance sampling follows PBRT's InfiniteAreaLight, with alias tables
+//  in place of the piecewise-constant CDFs.
+
+#include "EnvironmentMap.h"
+#include <algorithm>
+#include "hdrloader.h"
+
+bool EnvironmentMap::load(const char *filename){
+    HDRLoaderResult hdr;
+    if (!HDRLoader::load(filename, hdr)) {
+        std::cout << "Can't load environment map '" << filename << "'." << std::endl;
+        return false;
+    }
+    width = hdr.width;
+    height = hdr.height;
+    texels.resize(width * height);
+    for (int i = 0; i < width * height; i++) {
+        texels[i] = Colr(hdr.cols + 3*i);
+    }
+    delete [] hdr.cols;
+
+    // Rows near the poles cover less solid angle, hence the sin(theta) weight.
+    std::vector<float> rowWeights(height);
+    std::vector<float> weights(width);
+    columnDistributions.resize(height);
+    for (int y = 0; y < height; y++) {
+        float sinTheta = sin(M_PI * (y + 0.5) / height);
+        for (int x = 0; x < width; x++) {
+            weights[x] = texels[y * width + x].luminance() * sinTheta;
+        }
+        columnDistributions[y].build(weights);
+        rowWeights[y] = columnDistributions[y].total();
+    }
+    rowDistribution.build(rowWeights);
+    std::cout << "Loaded " << width << "x" << height << " environment map " << filename << std::endl;
+    return true;
+}
+
+void EnvironmentMap::directionToUV(const Vec3f &d, float &u, float &v) const {
+    u = 0.5 + atan2(d.x, -d.z) * (0.5 / M_PI);
+    v = acos(fmax(-1.0, fmin(1.0, d.y))) / M_PI;
+}
+
+Vec3f EnvironmentMap::uvToDirection(const float u, const float v) const {
+    float phi = (u - 0.5) * 2.0 * M_PI;
+    float theta = v * M_PI;
+    return Vec3f(sin(theta) * sin(phi), cos(theta), -sin(theta) * cos(phi));
+}
+
+const Colr& EnvironmentMap::texel(const float u, const float v) const {
+    int x = std::min((int)(u * width), width - 1);
+    int y = std::min((int)(v * height), height - 1);
+    return texels[std::max(y, 0) * width + std::max(x, 0)];
+}
+
+Colr EnvironmentMap::lookup(const Vec3f &direction) const {
+    float u, v;
+    directionToUV(direction, u, v);
+    return texel(u, v);
+}
+
+Colr EnvironmentMap::sample(const float u1, const float u2, Vec3f &direction, float &pdf) const {
+    pdf = 0;
+    if (rowDistribution.empty()) { return Colr(0,0,0); }
+    float dv, du;
+    int y = rowDistribution.sample(u1, dv);
+    int x = columnDistributions[y].sample(u2, du);
+    float u = (x + du) / width;
+    float v = (y + dv) / height;
+
+    float sinTheta = sin(v * M_PI);
+    if (sinTheta <= 0) { return Colr(0,0,0); }
+    direction = uvToDirection(u, v);
+    // Density over the image is uniform inside a texel: p(u,v) = p(row) * p(column|row) * width * height.
+    float pdfUV = rowDistribution.pdf(y) * columnDistributions[y].pdf(x) * width * height;
+    pdf = pdfUV / (2.0 * M_PI * M_PI * sinTheta);
+    return texels[y * width + x];
+}
+
+float EnvironmentMap::pdf(const Vec3f &direction) const {
+    if (rowDistribution.empty()) { return 0; }
+    float u, v;
+    directionToUV(direction, u, v);
+    float sinTheta = sin(v * M_PI);
+    if (sinTheta <= 0) { return 0; }
+    int x = std::min((int)(u * width), width - 1);
+    int y = std::min((int)(v * height), height - 1);
+    float pdfUV = rowDistribution.pdf(y) * columnDistributions[y].pdf(x) * width * height;
+    return pdfUV / (2.0 * M_PI * M_PI * sinTheta);
+}
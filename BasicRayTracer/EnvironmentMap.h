@@ -0,0 +1,39 @@
+//
+//  EnvironmentMap.h
+//  BasicRayTracer
+//
+//  Latitude-longitude HDR environment light (+y is up), loaded through HDRLoader.
+//  Texels are importance sampled by luminance * sin(theta) with alias tables:
+//  one over rows, and one over the texels of each row.
+//
+
+#ifndef __BasicRayTracer__EnvironmentMap__
+#define __BasicRayTracer__EnvironmentMap__
+
+#include <vector>
+#include "Vec3f.h"
+#include "AliasTable.h"
+
+class EnvironmentMap {
+private:
+    int width;
+    int height;
+    std::vector<Colr> texels;
+    AliasTable rowDistribution;
+    std::vector<AliasTable> columnDistributions;
+
+    void directionToUV(const Vec3f &direction, float &u, float &v) const;
+    Vec3f uvToDirection(const float u, const float v) const;
+    const Colr& texel(const float u, const float v) const;
+public:
+    EnvironmentMap():width(0), height(0){};
+    bool load(const char *filename);
+
+    // Radiance arriving from `direction`.
+    Colr lookup(const Vec3f &direction) const;
+    // Pick a direction proportional to the map's brightness. pdf is per unit solid angle.
+    Colr sample(const float u1, const float u2, Vec3f &direction, float &pdf) const;
+    float pdf(const Vec3f &direction) const;
+};
+
+#endif /* defined(__BasicRayTracer__EnvironmentMap__) */
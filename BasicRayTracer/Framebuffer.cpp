@@ -5,29 +5,38 @@
 //  Created by Arve Nygård on 26/02/15.
 //  Copyright (c) 2015 Arve Nygård. All rights reserved.
 //
-#define INV_GAMMA 0.45 //    gamma: 1 / 2.2
+/* Adaptive sampling. Tiles keep receiving samples until the mean relative
+   standard error of their pixels drops below the job's threshold, or the budget
+   (samplesPerPixel on average over the image) is spent. */
+#define ADAPTIVE_TILE_SIZE 8
+#define ADAPTIVE_MIN_SAMPLES 4          // Samples per pixel in the first pass.
+#define ADAPTIVE_PASS_SAMPLES 4         // Samples per pixel added to an unconverged tile in each later pass.
+#define ADAPTIVE_ERROR_EPSILON 0.01     // Keeps near-black pixels from never converging.
+#define STREAM_BAND_ROWS 16             // Scanlines rendered before a band is handed to the writer.
+#define RENDER_TILE_SIZE 16             // Pixels on a side of the tiles handed to render threads.
 #include "Framebuffer.h"
 #include "Mesh.h"
+#include "Timer.h"
+#include "Profiler.h"
+#include "SampleStream.h"
+#include "Wavefront.h"
+#include "hdrloader.h"
+#include "hdrwriter.h"
 float Framebuffer::jitter(const float distance) const{
-    return -distance + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(distance*2)));
+    return -distance + SampleStream::next() * (distance*2);
 }
 
-extern SceneIO *scene;
 
 
-
-void Framebuffer::renderPinhole(char* filename, const float sensorDistance){
-
-
-
-    Pos E = Pos(scene->camera->position); // Eye position
-    Vec3f V = Vec3f(scene->camera->viewDirection).normalize(); // View direction
-    Vec3f U = Vec3f(scene->camera->orthoUp).normalize(); // Camera Up vector (orthoUp)
+void Framebuffer::pinholeCamera(const float sensorDistance, Pos &E, Pos &M, Vec3f &X, Vec3f &Y) const {
+    E = Pos(camera.position); // Eye position
+    Vec3f V = Vec3f(camera.viewDirection).normalize(); // View direction
+    Vec3f U = Vec3f(camera.orthoUp).normalize(); // Camera Up vector (orthoUp)
 
 
     int w = WIDTH;
     int h = HEIGHT;
-    float fovVertical = scene->camera->verticalFOV;
+    float fovVertical = camera.verticalFOV;
     float fovHorizontal = fovVertical * ((float)w/(float)h);
 
     Vec3f A = Vec3f::cross(V, U); // Right vector
@@ -35,42 +44,322 @@ void Framebuffer::renderPinhole(char* filename, const float sensorDistance){
     A = A.normalize();
     B = B.normalize();
     float c = sensorDistance;
-    Pos M = E + (V*c); // Middle of image plane.
-    Vec3f Y = B * (c * tan(fovVertical / 2.0));
-    Vec3f X = A * (c * tan(fovHorizontal / 2.0));
+    M = E + (V*c); // Middle of image plane.
+    Y = B * (c * tan(fovVertical / 2.0));
+    X = A * (c * tan(fovHorizontal / 2.0));
+}
 
-    float dw = 1.0/WIDTH;
-    float dh = 1.0/HEIGHT;
+void Framebuffer::renderPinhole(char* filename, const float sensorDistance){
+    Pos E, M;
+    Vec3f X, Y;
+    pinholeCamera(sensorDistance, E, M, X, Y);
+
+    for (int j = 0; j < HEIGHT; j++) {
+        PROFILE_SCOPE_VALUE("row", j);
+        std::cout << "Rendering line " << j << std::endl;
+        for (int i = 0; i < WIDTH; i++) {
+            Pixel p = Pixel(samples, Pos());
+            p.filteredColor = pinholePixel(i, j, E, M, X, Y) * (1.0 / (samples * samples));
+            maxIntensity = fmax(maxIntensity, p.filteredColor.length());
+            pixels.push_back(p);
+        }
+    }
+    save(filename);
+}
+
+/* renderPinhole split into tiles that the pool's threads take in turn. Each pixel
+   only depends on its own rays, so the tiles can finish in any order. */
+void Framebuffer::renderTiles(const float sensorDistance, WorkerPool &pool){
+    Pos E, M;
+    Vec3f X, Y;
+    pinholeCamera(sensorDistance, E, M, X, Y);
+
+    pixels.assign(WIDTH * HEIGHT, Pixel(samples, Pos()));
+    int tilesX = (WIDTH + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    int tilesY = (HEIGHT + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    std::cout << "Rendering " << tilesX * tilesY << " tiles on " << pool.threadCount() << " threads" << std::endl;
+    float invSamples = 1.0 / (samples * samples);
+    pool.run(tilesX * tilesY, [&](long tile){
+        PROFILE_SCOPE_VALUE("tile", tile);
+        int tx = tile % tilesX;
+        int ty = tile / tilesX;
+        for (int j = ty * RENDER_TILE_SIZE; j < std::min(HEIGHT, (ty + 1) * RENDER_TILE_SIZE); j++) {
+            for (int i = tx * RENDER_TILE_SIZE; i < std::min(WIDTH, (tx + 1) * RENDER_TILE_SIZE); i++) {
+                pixels[j * WIDTH + i].filteredColor = pinholePixel(i, j, E, M, X, Y) * invSamples;
+            }
+        }
+    });
+    for (Pixel &p: pixels) {
+        maxIntensity = fmax(maxIntensity, p.filteredColor.length());
+    }
+}
 
+/* renderTiles() with each tile's samples traced breadth first, stage by stage. See Wavefront.h. */
+void Framebuffer::renderWavefront(const float sensorDistance, WorkerPool &pool){
+    Pos E, M;
+    Vec3f X, Y;
+    pinholeCamera(sensorDistance, E, M, X, Y);
+
+    pixels.assign(WIDTH * HEIGHT, Pixel(samples, Pos()));
+    int tilesX = (WIDTH + WAVEFRONT_TILE_SIZE - 1) / WAVEFRONT_TILE_SIZE;
+    int tilesY = (HEIGHT + WAVEFRONT_TILE_SIZE - 1) / WAVEFRONT_TILE_SIZE;
+    std::cout << "Rendering " << tilesX * tilesY << " wavefront tiles on " << pool.threadCount() << " threads" << std::endl;
+    float invSamples = 1.0 / (samples * samples);
+    pool.run(tilesX * tilesY, [&](long tile){
+        PROFILE_SCOPE_VALUE("wavefront tile", tile);
+#ifdef RAY_STATS
+        Timer timer;
+        timer.start();
+#endif
+        // One per thread, so the queues keep their capacity from tile to tile.
+        thread_local Wavefront wavefront;
+        int x0 = (tile % tilesX) * WAVEFRONT_TILE_SIZE, x1 = std::min(WIDTH, x0 + WAVEFRONT_TILE_SIZE);
+        int y0 = (tile / tilesX) * WAVEFRONT_TILE_SIZE, y1 = std::min(HEIGHT, y0 + WAVEFRONT_TILE_SIZE);
+        int tileWidth = x1 - x0;
+        wavefront.begin(tileWidth * (y1 - y0));
+        {
+            PROFILE_SCOPE("generate");
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    for(int sampleCountY = 0; sampleCountY < samples; sampleCountY++){
+                        for(int sampleCountX = 0; sampleCountX < samples; sampleCountX++){
+                            Pos samplePosition = pinholeSample(i, j, sampleCountX, sampleCountY, M, X, Y);
+                            SampleStream::beginPixel(i, j, sampleCountY * samples + sampleCountX);
+                            wavefront.addCameraRay(Ray(E, samplePosition - E), (j - y0) * tileWidth + (i - x0), 5);
+                        }
+                    }
+                }
+            }
+        }
+        const std::vector<Colr> &sums = wavefront.trace();
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                pixels[j * WIDTH + i].filteredColor = sums[(j - y0) * tileWidth + (i - x0)] * invSamples;
+            }
+        }
+#ifdef RAY_STATS
+        // The samples are traced breadth first, so only the whole tile has a time to split.
+        timer.stop();
+        float cost = timer.getElapsedTimeInMicroSec() / (tileWidth * (y1 - y0));
+        for (int j = y0; j < y1; j++) {
+            std::fill(pixelCost.begin() + j * WIDTH + x0, pixelCost.begin() + j * WIDTH + x1, cost);
+        }
+#endif
+    });
+    for (Pixel &p: pixels) {
+        maxIntensity = fmax(maxIntensity, p.filteredColor.length());
+    }
+}
+
+/* Where camera sample (sampleX, sampleY) of pixel (i, j) crosses the image plane. */
+Pos Framebuffer::pinholeSample(const int i, const int j, const int sampleX, const int sampleY, const Pos &M, const Vec3f &X, const Vec3f &Y) const {
+    float sx = i * (1.0/WIDTH);
+    float sy = j * (1.0/HEIGHT);
     float sampleOffsetX = 1.0/(samples*WIDTH);
     float sampleOffsetY = 1.0/(samples*HEIGHT);
 
+    Pos PixelCenterPosition = M + X*(2.0 * sx - 1.0) + Y * (2.0 * sy - 1.0);
+    return PixelCenterPosition
+    + X * sampleOffsetX * sampleX
+    + Y * sy * sampleOffsetY * sampleY;
+}
+
+/* Sum of the samples*samples grid of camera rays through pixel (i, j). */
+Colr Framebuffer::pinholePixel(const int i, const int j, const Pos &E, const Pos &M, const Vec3f &X, const Vec3f &Y) {
+#ifdef RAY_STATS
+    Timer timer;
+    timer.start();
+#endif
+    Colr sum = Colr(0,0,0);
+    for(int sampleCountY = 0; sampleCountY < samples; sampleCountY++){
+        for(int sampleCountX = 0; sampleCountX < samples; sampleCountX++){
+            Pos samplePosition = pinholeSample(i, j, sampleCountX, sampleCountY, M, X, Y);
+            SampleStream::beginPixel(i, j, sampleCountY * samples + sampleCountX);
+            sum += Ray(E, samplePosition - E).trace(5);
+        }
+    }
+#ifdef RAY_STATS
+    timer.stop();
+    pixelCost[j * WIDTH + i] = timer.getElapsedTimeInMicroSec();
+#endif
+    return sum;
+}
+
+/* Pinhole render that never holds the whole image: the pool's threads share the rows of
+   each band of scanlines, which then goes straight to an ImageWriter that encodes and writes
+   it on its own thread while the next band renders.
+   There is no global maximum to normalize by, so LDR output uses a fixed exposure. */
+void Framebuffer::renderStreaming(const char *filename, const float sensorDistance, WorkerPool &pool){
+    Pos E, M;
+    Vec3f X, Y;
+    pinholeCamera(sensorDistance, E, M, X, Y);
+
+    ImageWriter writer(filename, WIDTH, HEIGHT);
+    if (!writer.isOpen()) { return; }
+
+    std::cout << "Streaming " << (HEIGHT + STREAM_BAND_ROWS - 1) / STREAM_BAND_ROWS << " bands on " << pool.threadCount() << " threads" << std::endl;
+    float invSamples = 1.0 / (samples * samples);
+    std::vector<Colr> band;
+    for (int firstRow = 0; firstRow < HEIGHT; firstRow += STREAM_BAND_ROWS) {
+        int rowCount = std::min(STREAM_BAND_ROWS, HEIGHT - firstRow);
+        PROFILE_SCOPE_VALUE("band", firstRow);
+        band.resize(rowCount * WIDTH);
+        pool.run(rowCount, [&](long j){
+            for (int i = 0; i < WIDTH; i++) {
+                band[j * WIDTH + i] = pinholePixel(i, firstRow + (int)j, E, M, X, Y) * invSamples;
+            }
+        });
+        writer.writeRows(firstRow, rowCount, band);
+    }
+    writer.close();
+}
+
+
+/* Like renderTiles(), the pool's threads take the tiles of each pass in turn. Which tiles a
+   pass samples is settled before it starts, so the result doesn't depend on the threads. */
+void Framebuffer::renderAdaptive(const float sensorDistance, const float threshold, WorkerPool &pool){
+    Pos E, M;
+    Vec3f X, Y;
+    pinholeCamera(sensorDistance, E, M, X, Y);
+
+    float dw = 1.0/WIDTH;
+    float dh = 1.0/HEIGHT;
+
+    pixels.clear();
     for (int j = 0; j < HEIGHT; j++) {
-        std::cout << "Rendering line " << j << std::endl;
         for (int i = 0; i < WIDTH; i++) {
-            float sx = (i) * dw;
-            float sy = (j) * dh;
-            Pos PixelCenterPosition = M + X*(2.0 * sx - 1.0) + Y * (2.0 * sy - 1.0);
-            Pixel p = Pixel(samples, PixelCenterPosition);
-            for(int sampleCountY = 0; sampleCountY < samples; sampleCountY++){
-                for(int sampleCountX = 0; sampleCountX < samples; sampleCountX++){
-                    Pos samplePosition = PixelCenterPosition
-                    + X * sampleOffsetX * sampleCountX
-                    + Y * sy * sampleOffsetY * sampleCountY;
-                    Colr sample = Ray(E, samplePosition - E).trace(5);
-                    p.samples.push_back(sample);
-                }
+            pixels.push_back(Pixel(0, M + X*(2.0 * i * dw - 1.0) + Y * (2.0 * j * dh - 1.0)));
+        }
+    }
+
+    long budget = (long)samplesPerPixel * WIDTH * HEIGHT;
+    long spent = 0;
+    Timer timer;
+    timer.start();
+
+    // Jittered samples anywhere inside the pixel footprint.
+    auto samplePixel = [&](const int i, const int j, const int count){
+#ifdef RAY_STATS
+        Timer timer;
+        timer.start();
+#endif
+        Pixel &p = pixels[j * WIDTH + i];
+        for (int n = 0; n < count; n++) {
+            SampleStream::beginPixel(i, j, p.sampleCount);
+            Pos samplePosition = p.position
+            + X * (2.0 * dw * (jitter(0.5) + 0.5))
+            + Y * (2.0 * dh * (jitter(0.5) + 0.5));
+            p.addSample(Ray(E, samplePosition - E).trace(5));
+        }
+#ifdef RAY_STATS
+        // Summed over the passes; a pass only gives each pixel to one thread.
+        timer.stop();
+        pixelCost[j * WIDTH + i] += timer.getElapsedTimeInMicroSec();
+#endif
+    };
+    int tilesX = (WIDTH + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    int tilesY = (HEIGHT + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    int tileCount = tilesX * tilesY;
+    auto sampleTile = [&](const int tile, const int count){
+        int tx = tile % tilesX, ty = tile / tilesX;
+        for (int j = ty * ADAPTIVE_TILE_SIZE; j < std::min(HEIGHT, (ty + 1) * ADAPTIVE_TILE_SIZE); j++) {
+            for (int i = tx * ADAPTIVE_TILE_SIZE; i < std::min(WIDTH, (tx + 1) * ADAPTIVE_TILE_SIZE); i++) {
+                samplePixel(i, j, count);
             }
-            p.filter();
-            maxIntensity = fmax(maxIntensity, p.filteredColor.length());
-            pixels.push_back(p);
+        }
+    };
+    std::cout << "Rendering " << tileCount << " adaptive tiles on " << pool.threadCount() << " threads" << std::endl;
+
+    // First pass: every pixel needs a few samples before its variance means anything.
+    int initialSamples = std::min(ADAPTIVE_MIN_SAMPLES, std::max(samplesPerPixel, 1));
+    pool.run(tileCount, [&](long tile){
+        PROFILE_SCOPE_VALUE("tile", tile);
+        sampleTile((int)tile, initialSamples);
+    });
+    spent += (long)initialSamples * WIDTH * HEIGHT;
+
+    std::vector<std::pair<float, int> > activeTiles;
+    std::vector<int> passTiles;
+    int pass = 1;
+    while (spent < budget) {
+        activeTiles.clear();
+        for (int tile = 0; tile < tileCount; tile++) {
+            float error = tileError(tile % tilesX, tile / tilesX);
+            if (error > threshold) {
+                activeTiles.push_back(std::make_pair(error, tile));
+            }
+        }
+        std::cout << "Adaptive pass " << pass << ": " << activeTiles.size() << "/" << tileCount
+        << " tiles above threshold, " << spent << "/" << budget << " samples spent." << std::endl;
+        if (activeTiles.empty()) { break; }
+
+        // Worst tiles first, so a budget that runs out mid-pass goes where it matters most.
+        std::sort(activeTiles.begin(), activeTiles.end(), std::greater<std::pair<float, int> >());
+        passTiles.clear();
+        for (auto &tile: activeTiles) {
+            if (spent >= budget) { break; }
+            int tx = tile.second % tilesX, ty = tile.second / tilesX;
+            int tilePixels = (std::min(WIDTH, (tx + 1) * ADAPTIVE_TILE_SIZE) - tx * ADAPTIVE_TILE_SIZE)
+            * (std::min(HEIGHT, (ty + 1) * ADAPTIVE_TILE_SIZE) - ty * ADAPTIVE_TILE_SIZE);
+            passTiles.push_back(tile.second);
+            spent += (long)tilePixels * ADAPTIVE_PASS_SAMPLES;
+        }
+        pool.run(passTiles.size(), [&](long k){
+            PROFILE_SCOPE_VALUE("tile", passTiles[k]);
+            sampleTile(passTiles[k], ADAPTIVE_PASS_SAMPLES);
+        });
+        pass++;
+    }
+    timer.stop();
+
+    int minSamples = INT_MAX, maxSamples = 0;
+    for (Pixel &p: pixels) {
+        p.filteredColor = p.sum * (1.0 / p.sampleCount);
+        maxIntensity = fmax(maxIntensity, p.filteredColor.length());
+        minSamples = std::min(minSamples, p.sampleCount);
+        maxSamples = std::max(maxSamples, p.sampleCount);
+    }
+    std::cout << "Adaptive sampling: " << spent << " samples in " << pass << " passes ("
+    << minSamples << "-" << maxSamples << " per pixel), "
+    << spent / timer.getElapsedTimeInSec() << " samples/sec." << std::endl;
+}
+
+float Framebuffer::tileError(const int tileX, const int tileY) const {
+    float error = 0;
+    int count = 0;
+    for (int j = tileY * ADAPTIVE_TILE_SIZE; j < std::min(HEIGHT, (tileY + 1) * ADAPTIVE_TILE_SIZE); j++) {
+        for (int i = tileX * ADAPTIVE_TILE_SIZE; i < std::min(WIDTH, (tileX + 1) * ADAPTIVE_TILE_SIZE); i++) {
+            error += pixels[j * WIDTH + i].relativeError();
+            count++;
         }
     }
-    filter();
-    saveFile(filename, false);
+    return error / count;
 }
 
 
+void Pixel::addSample(const Colr &sample){
+    float luminance = sample.luminance();
+    sum += sample;
+    lumSum += luminance;
+    lumSumSq += luminance * luminance;
+    sampleCount++;
+}
+
+/* Unbiased sample variance of the luminance. */
+float Pixel::variance() const {
+    if (sampleCount < 2) { return INFINITY; }
+    float mean = lumSum / sampleCount;
+    float variance = (lumSumSq / sampleCount - mean * mean) * sampleCount / (sampleCount - 1);
+    return fmax(0.0, variance);
+}
+
+/* Standard error of the mean luminance, relative to the mean. */
+float Pixel::relativeError() const {
+    if (sampleCount < 2) { return INFINITY; }
+    float mean = lumSum / sampleCount;
+    return sqrt(variance() / sampleCount) / (mean + ADAPTIVE_ERROR_EPSILON);
+}
+
 void Pixel::filter(){
     int count = samples.size();
     for (Colr sample: samples){
@@ -82,17 +371,142 @@ void Pixel::filter(){
 }
 
 
-void Framebuffer::filter(){
-    // Precondition: maxIntensity is the magnitude of the brightest channel of the brightest pixel. Renormalize so this is equal to 1.
+Colr Framebuffer::toneMap(const Colr &linear, const float maxIntensity){
+    // Precondition: maxIntensity is the magnitude of the brightest pixel. Renormalize so this is equal to 1.
     // Linear mapping for now.
     // http://stackoverflow.com/questions/1456000/rescaling-ranges
-    float factor = 1.0/maxIntensity;
-    for (Pixel &p: pixels) {
-        p.filteredColor = p.filteredColor * factor * 1.73;
-        p.filteredColor.x = powf(p.filteredColor.x,INV_GAMMA);
-        p.filteredColor.y = powf(p.filteredColor.y,INV_GAMMA);
-        p.filteredColor.z = powf(p.filteredColor.z,INV_GAMMA);
+    Colr c = linear * (1.73 / maxIntensity);
+    return Colr(powf(fminf(c.x, 1.0), INV_GAMMA),
+                powf(fminf(c.y, 1.0), INV_GAMMA),
+                powf(fminf(c.z, 1.0), INV_GAMMA));
+}
+
+/* .hdr and .pfm get the linear pixels as they are; anything else is tone mapped to a BMP. */
+void Framebuffer::save(char *filename){
+    PROFILE_SCOPE("write image");
+    if (HDRWriter::isHDRFileName(filename) || ImageWriter::formatForFilename(filename) == ImageWriter::PFM) {
+        saveHDR(filename);
+    } else {
+        saveFile(filename, false);
+    }
+}
+
+bool Framebuffer::saveHDR(const char *filename) const {
+    if (ImageWriter::formatForFilename(filename) == ImageWriter::PFM) {
+        // The whole image as one band.
+        ImageWriter writer(filename, WIDTH, HEIGHT);
+        if (!writer.isOpen()) { return false; }
+        std::vector<Colr> colors(WIDTH * HEIGHT);
+        for (int i = 0; i < WIDTH * HEIGHT; i++) {
+            colors[i] = pixels[i].filteredColor;
+        }
+        writer.writeRows(0, HEIGHT, colors);
+        writer.close();
+        return true;
+    }
+    HDRWriter writer;
+    if (!writer.open(filename, WIDTH, HEIGHT)) {
+        std::cout << "Can't open file '" << filename << "' for writing." << std::endl;
+        return false;
+    }
+    std::vector<float> scanline(WIDTH * 3);
+    for (int r = 0; r < HEIGHT; r++) {
+        int h = HEIGHT - r - 1; // Pixel row 0 is the bottom of the image.
+        for (int w = 0; w < WIDTH; w++) {
+            const Colr &c = pixels[h*WIDTH+w].filteredColor;
+            scanline[3*w] = c.x;
+            scanline[3*w+1] = c.y;
+            scanline[3*w+2] = c.z;
+        }
+        writer.writeScanline(&scanline[0]);
+    }
+    writer.close();
+    return true;
+}
+
+#ifdef RAY_STATS
+bool Framebuffer::saveCostMap(const char *filename) const {
+    std::vector<float> sorted(pixelCost);
+    std::sort(sorted.begin(), sorted.end());
+    float scale = sorted.empty() ? 0 : sorted[(sorted.size() - 1) * 99 / 100];
+    BMP image;
+    image.SetBitDepth(24);
+    image.SetSize(WIDTH, HEIGHT);
+    for (int h = 0; h < HEIGHT; h++) {
+        for (int w = 0; w < WIDTH; w++) {
+            float c = scale > 0 ? fminf(pixelCost[h*WIDTH+w] / scale, 1.0f) : 0;
+            // Three ramps over [0, 1]: black to blue, blue to red, red to white.
+            float t = c * 3;
+            RGBApixel *pixel = image(w, HEIGHT - h - 1);
+            pixel->Blue = 255 * (t < 1 ? t : t < 2 ? 2 - t : t - 2);
+            pixel->Red = 255 * (t < 1 ? 0 : fminf(t - 1, 1.0f));
+            pixel->Green = 255 * (t < 2 ? 0 : t - 2);
+        }
+    }
+    std::cout << "Pixel cost: 99th percentile " << scale << " us, most " << (sorted.empty() ? 0 : sorted.back()) << " us." << std::endl;
+    return image.WriteToFile(filename);
+}
+#endif
+
+/* Reads a PFM as ImageWriter writes it into `result`, rows top-down like HDRLoader's. */
+static bool loadPFM(const char *filename, HDRLoaderResult &result){
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) { return false; }
+    int width, height;
+    float scale;
+    if (fscanf(file, "PF %d %d %f", &width, &height, &scale) != 3 || fgetc(file) != '\n' || width <= 0 || height <= 0) {
+        fclose(file);
+        return false;
+    }
+    // Negative scale means little-endian samples.
+    unsigned int probe = 1;
+    bool swap = (*(unsigned char *)&probe == 1) != (scale < 0);
+    result.width = width;
+    result.height = height;
+    result.cols = new float[width * height * 3];
+    for (int r = height - 1; r >= 0; r--) {
+        float *row = result.cols + r * width * 3;
+        if (fread(row, sizeof(float) * 3, width, file) != (size_t)width) {
+            delete [] result.cols;
+            fclose(file);
+            return false;
+        }
+        for (int i = 0; swap && i < width * 3; i++) {
+            unsigned char *b = (unsigned char *)&row[i];
+            std::swap(b[0], b[3]);
+            std::swap(b[1], b[2]);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/* Tone mapping as a separate step: turn a saved .hdr or .pfm render into an 8-bit BMP. */
+bool Framebuffer::toneMapFile(const char *hdrFilename, const char *ldrFilename){
+    HDRLoaderResult hdr;
+    bool pfm = ImageWriter::formatForFilename(hdrFilename) == ImageWriter::PFM;
+    if (!(pfm ? loadPFM(hdrFilename, hdr) : HDRLoader::load(hdrFilename, hdr))) {
+        std::cout << "Can't load HDR image '" << hdrFilename << "'." << std::endl;
+        return false;
+    }
+    float maxIntensity = 0;
+    for (int i = 0; i < hdr.width * hdr.height; i++) {
+        maxIntensity = fmax(maxIntensity, Colr(hdr.cols + 3*i).length());
+    }
+    BMP image;
+    image.SetBitDepth(24);
+    image.SetSize(hdr.width, hdr.height);
+    for (int h = 0; h < hdr.height; h++) {
+        for (int w = 0; w < hdr.width; w++) {
+            Colr c = toneMap(Colr(hdr.cols + 3*(h*hdr.width+w)), maxIntensity);
+            RGBApixel *pixel = image(w, h); // HDRLoader rows are top-down, like EasyBMP.
+            pixel->Red = c.x*255;
+            pixel->Green = c.y*255;
+            pixel->Blue = c.z*255;
+        }
     }
+    delete [] hdr.cols;
+    return image.WriteToFile(ldrFilename);
 }
 
 void Framebuffer::saveFile(char *filename, bool flip){
@@ -108,7 +522,7 @@ void Framebuffer::saveFile(char *filename, bool flip){
             if(flip){currentIndex = HEIGHT*WIDTH - (h*WIDTH+w) -2;}
             else { currentIndex = h*WIDTH+w; }
             RGBApixel *pixel = image(w, HEIGHT - h - 1);
-            Colr c = pixels[currentIndex].filteredColor;
+            Colr c = toneMap(pixels[currentIndex].filteredColor, maxIntensity);
             pixel->Red = c.x*255;
             pixel->Green = c.y*255;
             pixel->Blue = c.z*255;
@@ -123,12 +537,12 @@ void Framebuffer::saveFile(char *filename, bool flip){
 
 void Framebuffer::renderLens(char* filename, const float sensorDistance){
     auto result = std::vector<Pixel>();
-    Pos E = Pos(scene->camera->position); // Eye position
-    Vec3f V = Vec3f(scene->camera->viewDirection).normalize(); // View direction
-    Vec3f U = Vec3f(scene->camera->orthoUp).normalize(); // Camera Up vector (orthoUp)
+    Pos E = Pos(camera.position); // Eye position
+    Vec3f V = Vec3f(camera.viewDirection).normalize(); // View direction
+    Vec3f U = Vec3f(camera.orthoUp).normalize(); // Camera Up vector (orthoUp)
     int w = WIDTH;
     int h = HEIGHT;
-    float fovVertical = scene->camera->verticalFOV;
+    float fovVertical = camera.verticalFOV;
     float fovHorizontal = fovVertical * ((float)w/(float)h);
 
     //Lens Plane:
@@ -142,7 +556,7 @@ void Framebuffer::renderLens(char* filename, const float sensorDistance){
     Vec3f SensorY = LensY * sensorDistance * tanf(fovVertical / 2.0);
 
     // Focal plane
-    Pos FocalPlaneCenter = LensCenter + V * scene->camera->focalDistance ;
+    Pos FocalPlaneCenter = LensCenter + V * camera.focalDistance ;
     Vec3f FocalPlaneNormal = V*-1.0;
 
     // Create framebuffer pixels with their samples
@@ -178,6 +592,7 @@ void Framebuffer::renderLens(char* filename, const float sensorDistance){
                     Vec3f focusPoint = samplePositionOnSensor + directionFromSamplePositionToFocusPoint * r;
 
                     // Randomize lens plane point
+                    SampleStream::beginPixel(i, j, sampleCountY * samples + sampleCountX);
                     Pos lensPosition = LensCenter + LensX * jitter(0.8) // random along x-axis [-1,1]
                                                   + LensY * jitter(0.8);
                     Vec3f rayDirection = (focusPoint - lensPosition);
@@ -186,6 +601,7 @@ void Framebuffer::renderLens(char* filename, const float sensorDistance){
                 }
             }
             currentPixel.filter();
+            maxIntensity = fmax(maxIntensity, currentPixel.filteredColor.length());
             pixels.push_back(currentPixel);
         }
     }
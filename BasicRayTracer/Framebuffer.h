@@ -13,11 +13,16 @@
 #include <math.h>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <climits>
 #include "Vec3f.h"
 #include "Ray.h"
 #include "scene_io.h"
 #include "PhotonMap.h"
 #include "EasyBMP.h"
+#include "ImageWriter.h"
+#include "WorkerPool.h"
+#include "RayStats.h"
 
 struct Pixel {
 
@@ -26,9 +31,20 @@ struct Pixel {
     std::vector<Colr> samples;
     Colr filteredColor;
 
-    Pixel(int numSamples, Pos position):position(position),numSamples(numSamples), samples(std::vector<Colr>()), filteredColor(Colr(0,0,0)){};
+    // Running sums for adaptive sampling: samples are accumulated instead of stored.
+    int sampleCount;
+    Colr sum;
+    float lumSum;
+    float lumSumSq;
+
+    Pixel(int numSamples, Pos position):position(position),numSamples(numSamples), samples(std::vector<Colr>()), filteredColor(Colr(0,0,0)),
+    sampleCount(0), sum(Colr(0,0,0)), lumSum(0), lumSumSq(0){};
     void filter();
     float jitter(const float distance) const;
+
+    void addSample(const Colr &sample);
+    float variance() const;
+    float relativeError() const;
 };
 
 class Framebuffer {
@@ -37,18 +53,46 @@ private:
     int WIDTH;
     int HEIGHT;
     int samples;
+    int samplesPerPixel;
     float maxIntensity;
+    CameraIO camera;
+#ifdef RAY_STATS
+    std::vector<float> pixelCost;   // Microseconds spent on each pixel
+#endif
     void initblack();
+    float tileError(const int tileX, const int tileY) const;
+    void pinholeCamera(const float sensorDistance, Pos &E, Pos &M, Vec3f &X, Vec3f &Y) const;
+    Pos pinholeSample(const int i, const int j, const int sampleX, const int sampleY, const Pos &M, const Vec3f &X, const Vec3f &Y) const;
+    Colr pinholePixel(const int i, const int j, const Pos &E, const Pos &M, const Vec3f &X, const Vec3f &Y);
 public:
-    Framebuffer(const int w, const int h, const int samples):WIDTH(w), HEIGHT(h), samples(sqrt(samples)){};
+    Framebuffer(const int w, const int h, const int samples, const CameraIO &camera):WIDTH(w), HEIGHT(h), samples(sqrt(samples)), samplesPerPixel(samples), maxIntensity(0), camera(camera){
+#ifdef RAY_STATS
+        pixelCost.assign(w * h, 0);
+#endif
+    };
     void init(const float focaldistance, const float focalDistance);
     void  initPinhole(const float sensorDistance);
     void renderLens(char* filename, const float sensorDistance);
     void renderPinhole(char *filename, float sensorDistance);
+    // Writes `filename` band by band as it renders, without filling the framebuffer.
+    void renderStreaming(const char *filename, const float sensorDistance, WorkerPool &pool);
+    // Renders into the framebuffer only; save() writes it out, possibly on another thread.
+    void renderTiles(const float sensorDistance, WorkerPool &pool);
+    void renderWavefront(const float sensorDistance, WorkerPool &pool);
+    // Spends the samples where the pixels are noisiest, until every tile's relative error is below `threshold`.
+    void renderAdaptive(const float sensorDistance, const float threshold, WorkerPool &pool);
 
     float jitter(const float distance) const;
 
-    void filter();
+    static Colr toneMap(const Colr &linear, const float maxIntensity);
+    static bool toneMapFile(const char *hdrFilename, const char *ldrFilename);
+    void save(char *filename);
+    bool saveHDR(const char *filename) const;
     void saveFile(char *filename, bool flip);
+#ifdef RAY_STATS
+    // False-color image of the time each pixel took over all its samples, black through blue
+    // and red to white; wavefront renders give every pixel its tile's average. Scaled to the 99th percentile, so a few slow pixels don't wash out the rest.
+    bool saveCostMap(const char *filename) const;
+#endif
 };
 #endif /* defined(__reyes__framebuffer__) */
@@ -0,0 +1,179 @@
+//
+//  ImageWriter.cpp
+//  BasicRayTracer
+//
+
+#include "ImageWriter.h"
+#include "Profiler.h"
+#include <iostream>
+#include <string.h>
+#include <ctype.h>
+
+static void putLE16(unsigned char *p, const unsigned int v){
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void putLE32(unsigned char *p, const unsigned int v){
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static unsigned char toByte(const float linear, const float exposure){
+    float c = fminf(fmaxf(linear * exposure, 0.0f), 1.0f);
+    return (unsigned char)(powf(c, INV_GAMMA) * 255.0f + 0.5f);
+}
+
+ImageWriter::Format ImageWriter::formatForFilename(const char *filename){
+    const char *dot = strrchr(filename, '.');
+    if (dot == NULL) { return BMP; }
+    char ext[8] = {0};
+    for (int i = 0; i < 7 && dot[i+1] != '\0'; i++) {
+        ext[i] = tolower(dot[i+1]);
+    }
+    if (strcmp(ext, "ppm") == 0) { return PPM; }
+    if (strcmp(ext, "pfm") == 0) { return PFM; }
+    return BMP;
+}
+
+ImageWriter::ImageWriter(const char *filename, const int width, const int height, const float exposure)
+:format(formatForFilename(filename)), width(width), height(height), exposure(exposure), closing(false)
+{
+    file = fopen(filename, "wb");
+    if (file == NULL) {
+        std::cout << "Can't open file '" << filename << "' for writing." << std::endl;
+        return;
+    }
+    writeHeader();
+    worker = std::thread(&ImageWriter::run, this);
+}
+
+ImageWriter::~ImageWriter(){
+    close();
+}
+
+void ImageWriter::writeHeader(){
+    char header[64];
+    switch (format) {
+        case PPM:
+            headerSize = sprintf(header, "P6\n%d %d\n255\n", width, height);
+            rowBytes = width * 3;
+            fwrite(header, 1, headerSize, file);
+            break;
+        case PFM: {
+            // Negative scale means little-endian samples.
+            unsigned int probe = 1;
+            bool littleEndian = *(unsigned char *)&probe == 1;
+            headerSize = sprintf(header, "PF\n%d %d\n%s\n", width, height, littleEndian ? "-1.0" : "1.0");
+            rowBytes = width * 3 * sizeof(float);
+            fwrite(header, 1, headerSize, file);
+            break;
+        }
+        case BMP: {
+            unsigned char bmp[54] = {0};
+            rowBytes = (width * 3 + 3) & ~3;
+            headerSize = 54;
+            bmp[0] = 'B';
+            bmp[1] = 'M';
+            putLE32(bmp + 2, (unsigned int)(headerSize + rowBytes * height));
+            putLE32(bmp + 10, (unsigned int)headerSize);
+            putLE32(bmp + 14, 40);
+            putLE32(bmp + 18, width);
+            putLE32(bmp + 22, height); // Positive height: rows are stored bottom-up.
+            putLE16(bmp + 26, 1);
+            putLE16(bmp + 28, 24);
+            putLE32(bmp + 34, (unsigned int)(rowBytes * height));
+            putLE32(bmp + 38, 2835);
+            putLE32(bmp + 42, 2835);
+            fwrite(bmp, 1, headerSize, file);
+            break;
+        }
+    }
+}
+
+/* Every row has a fixed size, so bands can land in any order. */
+long ImageWriter::fileRow(const int row) const {
+    if (format == PPM) { return height - row - 1; } // PPM is stored top-down.
+    return row;
+}
+
+void ImageWriter::writeRows(const int firstRow, const int rowCount, std::vector<Colr> &colors){
+    if (file == NULL) { return; }
+    std::unique_lock<std::mutex> lock(mutex);
+    bandWritten.wait(lock, [this]{ return pending.size() < IMAGE_WRITER_MAX_PENDING; });
+    pending.push_back(Band());
+    Band &band = pending.back();
+    band.firstRow = firstRow;
+    band.rowCount = rowCount;
+    band.colors.swap(colors);
+    bandQueued.notify_one();
+}
+
+void ImageWriter::close(){
+    if (file == NULL) { return; }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    bandQueued.notify_one();
+    worker.join();
+    fclose(file);
+    file = NULL;
+}
+
+void ImageWriter::run(){
+    Profiler::nameThread("image writer");
+    std::vector<unsigned char> row(rowBytes);
+    while (true) {
+        Band band;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bandQueued.wait(lock, [this]{ return closing || !pending.empty(); });
+            if (pending.empty()) { return; }
+            band.firstRow = pending.front().firstRow;
+            band.rowCount = pending.front().rowCount;
+            band.colors.swap(pending.front().colors);
+            pending.pop_front();
+        }
+        bandWritten.notify_one();
+
+        PROFILE_SCOPE_VALUE("write band", band.firstRow);
+        for (int r = 0; r < band.rowCount; r++) {
+            encodeRow(&band.colors[r * width], row);
+            fseek(file, headerSize + fileRow(band.firstRow + r) * rowBytes, SEEK_SET);
+            fwrite(&row[0], 1, rowBytes, file);
+        }
+        // Partial results are readable as soon as a band lands.
+        fflush(file);
+    }
+}
+
+void ImageWriter::encodeRow(const Colr *colors, std::vector<unsigned char> &out) const {
+    switch (format) {
+        case PPM:
+            for (int x = 0; x < width; x++) {
+                out[3*x]   = toByte(colors[x].x, exposure);
+                out[3*x+1] = toByte(colors[x].y, exposure);
+                out[3*x+2] = toByte(colors[x].z, exposure);
+            }
+            break;
+        case PFM: {
+            float *f = (float *)&out[0];
+            for (int x = 0; x < width; x++) {
+                f[3*x]   = colors[x].x * exposure;
+                f[3*x+1] = colors[x].y * exposure;
+                f[3*x+2] = colors[x].z * exposure;
+            }
+            break;
+        }
+        case BMP:
+            for (int x = 0; x < width; x++) {
+                out[3*x]   = toByte(colors[x].z, exposure);
+                out[3*x+1] = toByte(colors[x].y, exposure);
+                out[3*x+2] = toByte(colors[x].x, exposure);
+            }
+            break;
+    }
+}
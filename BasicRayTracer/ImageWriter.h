@@ -0,0 +1,68 @@
+//
+//  ImageWriter.h
+//  BasicRayTracer
+//
+//  Streams finished scanline bands to disk on a background I/O thread,
+//  so a render never has to hold the whole image in memory.
+//
+
+#ifndef __BasicRayTracer__ImageWriter__
+#define __BasicRayTracer__ImageWriter__
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Vec3f.h"
+
+#define INV_GAMMA 0.45 //    gamma: 1 / 2.2
+#define IMAGE_WRITER_MAX_PENDING 8 // Bands queued before writeRows blocks the renderer.
+
+class ImageWriter {
+public:
+    typedef enum { PPM, PFM, BMP } Format;
+
+    /* Format is picked from the extension: .ppm, .pfm, anything else is written as .bmp.
+       Rows are numbered like the framebuffer: row 0 is the bottom of the image. */
+    ImageWriter(const char *filename, const int width, const int height, const float exposure = 1.0);
+    ~ImageWriter();
+
+    bool isOpen() const { return file != NULL; }
+    // Queue `rowCount` rows of linear colors starting at `firstRow`. Takes ownership of the data.
+    void writeRows(const int firstRow, const int rowCount, std::vector<Colr> &colors);
+    // Wait for every queued band to reach the disk, then close the file.
+    void close();
+
+    static Format formatForFilename(const char *filename);
+
+private:
+    struct Band {
+        int firstRow;
+        int rowCount;
+        std::vector<Colr> colors;
+    };
+
+    FILE *file;
+    Format format;
+    int width;
+    int height;
+    float exposure;
+    long headerSize;
+    long rowBytes;
+
+    std::deque<Band> pending;
+    std::mutex mutex;
+    std::condition_variable bandQueued;
+    std::condition_variable bandWritten;
+    bool closing;
+    std::thread worker;
+
+    void writeHeader();
+    void run();
+    void encodeRow(const Colr *colors, std::vector<unsigned char> &out) const;
+    long fileRow(const int row) const;
+};
+
+#endif /* defined(__BasicRayTracer__ImageWriter__) */
@@ -0,0 +1,123 @@
+//
+//  Instance.cpp
+//  BasicRayTracer
+//
+
+#include "Instance.h"
+#include <math.h>
+#include <string.h>
+
+// Positions of a translated copy are rounded differently, so they match to within this fraction of the coordinates' magnitude.
+#define INSTANCE_POSITION_TOLERANCE 1e-5f
+
+Instance::Instance(Mesh &mesh, const Vec3f &offset, const uint32_t firstMaterial, const char* _name): mesh(mesh), offset(offset), firstMaterial(firstMaterial){
+    name = _name;
+    bounds[0] = mesh.bounds[0] + offset;
+    bounds[1] = mesh.bounds[1] + offset;
+}
+
+bool Instance::intersect(Ray &ray){
+    if(!bboxIntersect(ray)){ return false; }
+    // A translation leaves the direction, and with it t, the barycentrics and the normal, unchanged.
+    const float closest = ray.t_max;
+    const Pos start = ray.startPosition;
+    ray.startPosition = start - offset;
+    mesh.intersect(ray);
+    ray.startPosition = start;
+    if(ray.t_max < closest){
+        ray.currentObject = this;
+        ray.materialId = ray.materialId - mesh.firstMaterial + firstMaterial;
+    }
+    return ray.t_max < INFINITY;
+}
+
+MaterialIO Instance::shadingMaterial(const Ray &ray) const {
+    return mesh.shadingMaterial(ray, firstMaterial);
+}
+
+void Instance::textureCoords(const Ray &ray, float &s, float &t) const {
+    mesh.textureCoords(ray, s, t);
+}
+
+#pragma mark - Mesh library
+
+namespace {
+
+void hashBytes(uint64_t &hash, const void *data, size_t size){
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+}
+
+template <typename T>
+void hashVector(uint64_t &hash, const MeshArray<T> &values){
+    size_t count = values.size();
+    hashBytes(hash, &count, sizeof(count));
+    if (count > 0) {
+        hashBytes(hash, &values[0], count * sizeof(T));
+    }
+}
+
+template <typename T>
+bool sameVector(const MeshArray<T> &a, const MeshArray<T> &b){
+    return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+}
+
+// Everything but the positions, which differ between copies. Vertex order
+// follows the file, so copies written the same way have the same indices.
+uint64_t MeshLibrary::shapeHash(const Mesh &mesh){
+    uint64_t hash = 14695981039346656037ULL;
+    int layout[4] = { mesh.normType, mesh.materialBinding, mesh.hasTextureCoords, (int)mesh.materialCount };
+    hashBytes(hash, layout, sizeof(layout));
+    size_t vertexCount = mesh.positions.size();
+    hashBytes(hash, &vertexCount, sizeof(vertexCount));
+    hashVector(hash, mesh.indices);
+    hashVector(hash, mesh.vertexNormals);
+    hashVector(hash, mesh.texCoords);
+    hashVector(hash, mesh.vertexMaterials);
+    return hash;
+}
+
+bool MeshLibrary::isCopy(const Mesh &prototype, const Mesh &mesh, Vec3f &offset){
+    if (prototype.normType != mesh.normType || prototype.materialBinding != mesh.materialBinding
+        || prototype.hasTextureCoords != mesh.hasTextureCoords || prototype.materialCount != mesh.materialCount
+        || prototype.positions.size() != mesh.positions.size() || prototype.positions.empty()
+        || !sameVector(prototype.indices, mesh.indices) || !sameVector(prototype.vertexNormals, mesh.vertexNormals)
+        || !sameVector(prototype.texCoords, mesh.texCoords) || !sameVector(prototype.vertexMaterials, mesh.vertexMaterials)) {
+        return false;
+    }
+    offset = mesh.positions[0] - prototype.positions[0];
+    float scale = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        scale = fmax(scale, fmax(fabsf(prototype.bounds[0][axis]), fabsf(prototype.bounds[1][axis])) + fabsf(offset[axis]));
+    }
+    const float tolerance = INSTANCE_POSITION_TOLERANCE * scale;
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        Vec3f error = mesh.positions[i] - (prototype.positions[i] + offset);
+        if (fabsf(error.x) > tolerance || fabsf(error.y) > tolerance || fabsf(error.z) > tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Mesh* MeshLibrary::find(const Mesh &mesh, Vec3f &offset) const {
+    auto range = meshes.equal_range(shapeHash(mesh));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (isCopy(*it->second, mesh, offset)) {
+            return it->second;
+        }
+    }
+    return NULL;
+}
+
+void MeshLibrary::add(Mesh *mesh){
+    meshes.insert(std::make_pair(shapeHash(*mesh), mesh));
+}
+
+void MeshLibrary::clear(){
+    meshes.clear();
+}
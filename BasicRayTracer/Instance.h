@@ -0,0 +1,51 @@
+//
+//  Instance.h
+//  BasicRayTracer
+//
+//  A placed copy of a Mesh. Instances share the mesh's vertices, triangles and
+//  kd-tree and only add a transform and their own materials, so memory and
+//  build time grow with the unique geometry in a scene rather than with the
+//  number of copies. Rays are moved into the mesh's space, traced through its
+//  tree, and the hit is reported on the instance.
+//
+//  The scene formats have no instancing of their own. MeshLibrary finds polysets
+//  that repeat an earlier mesh at another position, so the transform is a
+//  translation.
+//
+
+#ifndef __BasicRayTracer__Instance__
+#define __BasicRayTracer__Instance__
+
+#include <stdint.h>
+#include <unordered_map>
+#include "Primitive.h"
+#include "Mesh.h"
+
+class Instance : public Primitive {
+public:
+    Mesh &mesh;
+    Vec3f offset;               // World position = mesh position + offset
+    uint32_t firstMaterial;     // Stands in for the mesh's, with the same layout
+
+    Instance(Mesh &mesh, const Vec3f &offset, const uint32_t firstMaterial, const char* name);
+
+    virtual bool intersect(Ray &ray);
+    virtual MaterialIO shadingMaterial(const Ray &ray) const;
+    virtual void textureCoords(const Ray &ray, float &s, float &t) const;
+};
+
+/* Finished meshes by shape, to find the earlier mesh a new polyset is a translated copy of. */
+class MeshLibrary {
+private:
+    std::unordered_multimap<uint64_t, Mesh*> meshes;
+
+    static uint64_t shapeHash(const Mesh &mesh);
+    static bool isCopy(const Mesh &prototype, const Mesh &mesh, Vec3f &offset);
+public:
+    // A finished mesh that `mesh` (filled but not finished) repeats, and the offset to place it at.
+    Mesh* find(const Mesh &mesh, Vec3f &offset) const;
+    void add(Mesh *mesh);
+    void clear();
+};
+
+#endif /* defined(__BasicRayTracer__Instance__) */
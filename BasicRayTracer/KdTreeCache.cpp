@@ -0,0 +1,221 @@
+//
+//  KdTreeCache.cpp
+//  BasicRayTracer
+//
+
+#include "KdTreeCache.h"
+#include <string.h>
+#include <iostream>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#ifdef WIN32   // Windows system specific
+#include <direct.h>
+#else          // Unix based system specific
+#include <sys/stat.h>
+#endif
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+namespace {
+
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash = FNV_OFFSET_BASIS){
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+void flatten(Node *node, const std::unordered_map<Triangle*, uint32_t> &index,
+             std::vector<KdTreeCacheNode> &nodes, std::vector<uint32_t> &references){
+    KdTreeCacheNode flat;
+    memset(&flat, 0, sizeof(flat));
+    for (int k = 0; k < 3; k++) {
+        flat.boundsMin[k] = node->bounds.min[k];
+        flat.boundsMax[k] = node->bounds.max[k];
+    }
+    size_t position = nodes.size();
+    if (node->leaf) {
+        flat.axis = -1;
+        flat.firstReference = (uint32_t)references.size();
+        flat.referenceCount = (uint32_t)node->triangles.size();
+        for (Triangle *t: node->triangles) {
+            references.push_back(index.at(t));
+        }
+        nodes.push_back(flat);
+        return;
+    }
+    flat.axis = node->splitPlane.axis;
+    flat.splitPos = node->splitPlane.pos;
+    nodes.push_back(flat);
+    flatten(node->left, index, nodes, references);
+    nodes[position].right = (uint32_t)nodes.size();
+    flatten(node->right, index, nodes, references);
+}
+
+// Rebuilds the subtree stored in nodes [first, end). The preorder layout is checked
+// as it goes, so every node is used exactly once and a bad file can't loop.
+Node* unflatten(const KdTreeCacheNode *nodes, uint32_t first, uint32_t end, const uint32_t *references,
+                const KdTreeCacheHeader &header, const std::vector<Triangle*> &triangles, int depth){
+    if (first >= end || depth > KD_CACHE_MAX_DEPTH) { return NULL; }
+    const KdTreeCacheNode &flat = nodes[first];
+    Node *node = new Node();
+    node->bounds = Box(Vec3f(flat.boundsMin[0], flat.boundsMin[1], flat.boundsMin[2]),
+                       Vec3f(flat.boundsMax[0], flat.boundsMax[1], flat.boundsMax[2]));
+    if (flat.axis == -1) {
+        node->leaf = true;
+        node->left = node->right = NULL;
+        if (end != first + 1 || flat.firstReference > header.referenceCount
+            || flat.referenceCount > header.referenceCount - flat.firstReference) {
+            delete node;
+            return NULL;
+        }
+        node->triangles.reserve(flat.referenceCount);
+        for (uint32_t i = 0; i < flat.referenceCount; i++) {
+            uint32_t t = references[flat.firstReference + i];
+            if (t >= triangles.size()) {
+                delete node;
+                return NULL;
+            }
+            node->triangles.push_back(triangles[t]);
+        }
+        return node;
+    }
+    node->leaf = false;
+    node->splitPlane = SplitPlane(flat.axis, flat.splitPos);
+    node->left = node->right = NULL;
+    if (flat.axis < 0 || flat.axis > 2 || flat.right <= first + 1 || flat.right >= end) {
+        delete node;
+        return NULL;
+    }
+    node->left = unflatten(nodes, first + 1, flat.right, references, header, triangles, depth + 1);
+    node->right = node->left != NULL ? unflatten(nodes, flat.right, end, references, header, triangles, depth + 1) : NULL;
+    if (node->right == NULL) {
+        delete node;
+        return NULL;
+    }
+    return node;
+}
+
+}
+
+bool KdTreeCache::enabled = true;
+
+uint64_t KdTreeCache::key(const std::vector<Triangle*> &triangles){
+    // Anything that changes the tree for the same triangles goes in here too.
+    const double parameters[] = { KD_CACHE_VERSION, COST_TRAVERSE, COST_INTERSECT };
+    uint64_t hash = fnv1a(parameters, sizeof(parameters));
+    uint64_t count = triangles.size();
+    hash = fnv1a(&count, sizeof(count), hash);
+    for (Triangle *t: triangles) {
+        for (int k = 0; k < 3; k++) {
+            const Pos &p = t->position(k);
+            const float position[3] = { p.x, p.y, p.z };
+            hash = fnv1a(position, sizeof(position), hash);
+        }
+    }
+    return hash;
+}
+
+void KdTreeCache::fileName(uint64_t key, char *out, size_t size){
+    snprintf(out, size, "%s/%016llx.kdtree", KD_CACHE_DIRECTORY, (unsigned long long)key);
+}
+
+Node* KdTreeCache::load(const std::vector<Triangle*> &triangles){
+    if (!enabled) {
+        return NULL;
+    }
+    uint64_t hash = key(triangles);
+    char name[256];
+    fileName(hash, name, sizeof(name));
+
+    MappedFile file;
+    if (!file.open(name)) {
+        return NULL;
+    }
+    const KdTreeCacheHeader *header = (const KdTreeCacheHeader *)file.data();
+    uint64_t size = file.size();
+    bool valid = size >= sizeof(KdTreeCacheHeader)
+        && memcmp(header->magic, KD_CACHE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == KD_CACHE_VERSION
+        && header->headerSize == sizeof(KdTreeCacheHeader)
+        && header->fileSize == size
+        && header->key == hash
+        && header->triangleCount == triangles.size()
+        && header->nodeCount > 0
+        && (uint64_t)header->nodeCount * sizeof(KdTreeCacheNode) + (uint64_t)header->referenceCount * sizeof(uint32_t)
+           == size - sizeof(KdTreeCacheHeader)
+        && header->checksum == fnv1a(file.data() + sizeof(KdTreeCacheHeader), size - sizeof(KdTreeCacheHeader));
+    if (!valid) {
+        std::cout << "Ignoring stale or corrupt kd-tree cache " << name << std::endl;
+        return NULL;
+    }
+
+    const KdTreeCacheNode *nodes = (const KdTreeCacheNode *)(file.data() + sizeof(KdTreeCacheHeader));
+    const uint32_t *references = (const uint32_t *)(nodes + header->nodeCount);
+    Node *root = unflatten(nodes, 0, header->nodeCount, references, *header, triangles, 0);
+    if (root == NULL) {
+        std::cout << "Ignoring malformed kd-tree cache " << name << std::endl;
+        return NULL;
+    }
+    std::cout << "Loaded kd-tree from " << name << " (" << header->nodeCount << " nodes)" << std::endl;
+    return root;
+}
+
+void KdTreeCache::save(const std::vector<Triangle*> &triangles, Node *root){
+    if (!enabled) {
+        return;
+    }
+    std::unordered_map<Triangle*, uint32_t> index;
+    for (size_t i = 0; i < triangles.size(); i++) {
+        index[triangles[i]] = (uint32_t)i;
+    }
+    std::vector<KdTreeCacheNode> nodes;
+    std::vector<uint32_t> references;
+    flatten(root, index, nodes, references);
+
+    KdTreeCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KD_CACHE_MAGIC, sizeof(header.magic));
+    header.version = KD_CACHE_VERSION;
+    header.headerSize = sizeof(header);
+    header.key = key(triangles);
+    header.triangleCount = (uint32_t)triangles.size();
+    header.nodeCount = (uint32_t)nodes.size();
+    header.referenceCount = (uint32_t)references.size();
+    header.fileSize = sizeof(header) + nodes.size() * sizeof(KdTreeCacheNode) + references.size() * sizeof(uint32_t);
+    header.checksum = fnv1a(&nodes[0], nodes.size() * sizeof(KdTreeCacheNode));
+    if (!references.empty()) {
+        header.checksum = fnv1a(&references[0], references.size() * sizeof(uint32_t), header.checksum);
+    }
+
+#ifdef WIN32
+    _mkdir(KD_CACHE_DIRECTORY);
+#else
+    mkdir(KD_CACHE_DIRECTORY, 0755);
+#endif
+    // Written under a temporary name and renamed, so a crash never leaves a half-written entry behind.
+    char name[256], temporary[272];
+    fileName(header.key, name, sizeof(name));
+    snprintf(temporary, sizeof(temporary), "%s.tmp", name);
+    FILE *fp = fopen(temporary, "wb");
+    if (fp == NULL) {
+        std::cout << "Can't write kd-tree cache " << temporary << std::endl;
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(&nodes[0], sizeof(KdTreeCacheNode), nodes.size(), fp);
+    if (!references.empty()) {
+        fwrite(&references[0], sizeof(uint32_t), references.size(), fp);
+    }
+    bool ok = !ferror(fp);
+    ok = fclose(fp) == 0 && ok;
+    remove(name);
+    if (!ok || rename(temporary, name) != 0) {
+        std::cout << "Can't write kd-tree cache " << name << std::endl;
+        remove(temporary);
+    }
+}
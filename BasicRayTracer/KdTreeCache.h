@@ -0,0 +1,63 @@
+//
+//  KdTreeCache.h
+//  BasicRayTracer
+//
+//  Built kd-trees are saved to KD_CACHE_DIRECTORY, one file per mesh, named by
+//  an FNV-1a hash of the triangle positions and the build parameters. On a hit
+//  the file is mapped, validated and turned back into Nodes, skipping the SAH
+//  build. Anything that doesn't check out is ignored and the tree rebuilt.
+//
+//  File layout: header, then the nodes in preorder (the left child of node i
+//  is i + 1), then the triangle indices referenced by the leaves.
+//
+
+#ifndef __BasicRayTracer__KdTreeCache__
+#define __BasicRayTracer__KdTreeCache__
+
+#include <stdint.h>
+#include <vector>
+#include "kdTree.h"
+
+#define KD_CACHE_DIRECTORY "kdcache"
+#define KD_CACHE_MAGIC "RTKDTREE"
+#define KD_CACHE_VERSION 1
+#define KD_CACHE_MAX_DEPTH 1024
+
+struct KdTreeCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t key;
+    uint64_t checksum;          // FNV-1a of everything after the header
+    uint32_t triangleCount;
+    uint32_t nodeCount;
+    uint32_t referenceCount;
+    uint32_t pad;
+    uint64_t fileSize;
+};
+
+struct KdTreeCacheNode {
+    float boundsMin[3];
+    float boundsMax[3];
+    float splitPos;
+    int32_t axis;               // -1 for leaves
+    uint32_t right;             // Inner nodes: index of the right child
+    uint32_t firstReference;    // Leaves: range in the reference table
+    uint32_t referenceCount;
+    uint32_t pad;
+};
+
+class KdTreeCache {
+private:
+    static uint64_t key(const std::vector<Triangle*> &triangles);
+    static void fileName(uint64_t key, char *out, size_t size);
+public:
+    // Off: every load misses and nothing is saved, so each tree is built. On by default.
+    static bool enabled;
+    // The cached tree over `triangles`, or NULL on a miss, a stale entry or a corrupt file.
+    static Node* load(const std::vector<Triangle*> &triangles);
+    // Write `root` for the next run. Failures only cost the next run a rebuild.
+    static void save(const std::vector<Triangle*> &triangles, Node *root);
+};
+
+#endif /* defined(__BasicRayTracer__KdTreeCache__) */
@@ -0,0 +1,106 @@
+//
+//  MappedFile.cpp
+//  BasicRayTracer
+//
+
+#include "MappedFile.h"
+
+#ifndef WIN32  // Unix based system specific
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile():bytes(NULL), length(0)
+#ifdef WIN32
+, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile(){
+    close();
+}
+
+#ifdef WIN32
+
+bool MappedFile::open(const char *filename){
+    close();
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        close();
+        return false;
+    }
+    bytes = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (bytes == NULL) {
+        close();
+        return false;
+    }
+    length = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close(){
+    if (bytes != NULL) { UnmapViewOfFile(bytes); }
+    if (mapping != NULL) { CloseHandle(mapping); }
+    if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+    bytes = NULL;
+    length = 0;
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::release(size_t end){
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t pages = (end < length ? end : length) / info.dwPageSize * info.dwPageSize;
+    if (bytes != NULL && pages > 0) {
+        // Unlocking pages that aren't locked removes them from the working set.
+        VirtualUnlock((LPVOID)bytes, pages);
+    }
+}
+
+#else
+
+bool MappedFile::open(const char *filename){
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *address = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps its own reference to the file.
+    if (address == MAP_FAILED) { return false; }
+    bytes = (const unsigned char *)address;
+    length = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close(){
+    if (bytes != NULL) {
+        munmap((void *)bytes, length);
+    }
+    bytes = NULL;
+    length = 0;
+}
+
+void MappedFile::release(size_t end){
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = (end < length ? end : length) / pageSize * pageSize;
+    if (bytes != NULL && pages > 0) {
+        madvise((void *)bytes, pages, MADV_DONTNEED);
+    }
+}
+
+#endif
@@ -0,0 +1,40 @@
+//
+//  MappedFile.h
+//  BasicRayTracer
+//
+//  Read-only memory mapping of a whole file.
+//
+
+#ifndef __BasicRayTracer__MappedFile__
+#define __BasicRayTracer__MappedFile__
+
+#include <stddef.h>
+
+#ifdef WIN32   // Windows system specific
+#include <windows.h>
+#endif
+
+class MappedFile {
+private:
+    const unsigned char *bytes;
+    size_t length;
+#ifdef WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+public:
+    MappedFile();
+    ~MappedFile();
+    bool open(const char *filename);
+    void close();
+    // Drops the pages before byte `end` from the working set; they are read again if touched.
+    void release(size_t end);
+
+    bool isOpen() const { return bytes != NULL; }
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+#endif /* defined(__BasicRayTracer__MappedFile__) */
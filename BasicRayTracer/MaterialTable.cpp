@@ -0,0 +1,18 @@
+//
+//  MaterialTable.cpp
+//  BasicRayTracer
+//
+
+#include "MaterialTable.h"
+
+uint32_t MaterialTable::add(const MaterialIO *objectMaterials, long count){
+    uint32_t first = (uint32_t)materials.size();
+    if (count > 0) {
+        materials.insert(materials.end(), objectMaterials, objectMaterials + count);
+    }
+    return first;
+}
+
+void MaterialTable::clear(){
+    materials.clear();
+}
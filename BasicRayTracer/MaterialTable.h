@@ -0,0 +1,29 @@
+//
+//  MaterialTable.h
+//  BasicRayTracer
+//
+//  Every material in the scene, filled while loading and read-only while
+//  rendering. Primitives and hits refer to materials by their 32-bit index in
+//  here; shaders work on a copy made for the hit being shaded.
+//
+
+#ifndef __BasicRayTracer__MaterialTable__
+#define __BasicRayTracer__MaterialTable__
+
+#include <stdint.h>
+#include <vector>
+#include "scene_io.h"
+
+class MaterialTable {
+private:
+    std::vector<MaterialIO> materials;
+public:
+    // Appends an object's materials and returns the ID of the first; the rest follow it.
+    uint32_t add(const MaterialIO *objectMaterials, long count);
+    void clear();
+
+    const MaterialIO& operator[](const uint32_t id) const { return materials[id]; }
+    size_t size() const { return materials.size(); }
+};
+
+#endif /* defined(__BasicRayTracer__MaterialTable__) */
@@ -7,38 +7,165 @@
 //
 
 #include "Mesh.h"
+#include "KdTreeCache.h"
+#include <string.h>
+#include <unordered_map>
+#include "MaterialTable.h"
+#include "RayStats.h"
+#include "Profiler.h"
 #define EPSILON 0.00001f
-Mesh::Mesh(const PolySetIO polySet, const MaterialIO* materials, const long numMaterials, char* _name): materials(materials, materials + numMaterials), triangleCount(polySet.numPolys){
+extern MaterialTable materialTable;
+namespace {
+
+// Everything that can tell two corners apart. Fields the mesh doesn't use are zero.
+struct VertexKey {
+    float pos[3];
+    float norm[3];
+    float s, t;
+    int32_t materialIndex;
+    bool operator==(const VertexKey &other) const { return memcmp(this, &other, sizeof(VertexKey)) == 0; }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey &key) const {
+        const unsigned char *bytes = (const unsigned char *)&key;
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < sizeof(VertexKey); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+};
+
+}
+
+// Vertices added so far, by key, while the mesh is being built.
+struct Mesh::VertexLookup {
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> unique;
+    std::vector<uint32_t> corners;
+};
+
+Mesh::Mesh(const NormType normType, const MaterialBinding materialBinding, const bool hasTextureCoords, const uint32_t firstMaterial, const long materialCount, const char* _name): tree(NULL), firstMaterial(firstMaterial), materialCount(materialCount), triangleCount(0), materialBinding(materialBinding), normType(normType), hasTextureCoords(hasTextureCoords), area(0), vertexLookup(new VertexLookup()){
     name = _name;
-    if(polySet.type != POLYSET_TRI_MESH){ std::cout << "Unimplemented polyset type: " << polySet.type << std::endl; }
-    float numPolys = polySet.numPolys;
+}
+
+Mesh::Mesh(const PolySetIO polySet, const uint32_t firstMaterial, const long materialCount, const char* _name): Mesh(polySet.normType, polySet.materialBinding, polySet.hasTextureCoords, firstMaterial, materialCount, _name){
+    for(int i = 0; i < polySet.numPolys; i++){
+        addPolygon(polySet.poly[i].vert, polySet.poly[i].numVertices);
+    }
+    finish();
+}
+
+void Mesh::addPolygon(const VertexIO *vertices, const long vertexCount){
+    std::vector<uint32_t> &corners = vertexLookup->corners;
+    corners.clear();
+    for(long k = 0; k < vertexCount; k++){
+        const VertexIO &vertex = vertices[k];
+        VertexKey key;
+        memset(&key, 0, sizeof(key));
+        memcpy(key.pos, vertex.pos, sizeof(Point));
+        if(normType == PER_VERTEX_NORMAL){ memcpy(key.norm, vertex.norm, sizeof(Vec)); }
+        if(hasTextureCoords){ key.s = vertex.s; key.t = vertex.t; }
+        if(materialBinding == PER_VERTEX_MATERIAL){ key.materialIndex = (int32_t)vertex.materialIndex; }
+
+        auto found = vertexLookup->unique.find(key);
+        if(found == vertexLookup->unique.end()){
+            found = vertexLookup->unique.insert(std::make_pair(key, (uint32_t)positions.size())).first;
+            positions.push_back(Pos(vertex.pos));
+            if(normType == PER_VERTEX_NORMAL){ vertexNormals.push_back(Vec3f::normalize(Vec3f(vertex.norm))); }
+            if(hasTextureCoords){ texCoords.push_back(vertex.s); texCoords.push_back(vertex.t); }
+            if(materialBinding == PER_VERTEX_MATERIAL){ vertexMaterials.push_back(key.materialIndex); }
+        }
+        corners.push_back(found->second);
+    }
+    for(size_t k = 2; k < corners.size(); k++){
+        indices.push_back(corners[0]);
+        indices.push_back(corners[k - 1]);
+        indices.push_back(corners[k]);
+    }
+}
+
+void Mesh::finish(){
+    PROFILE_SCOPE_VALUE("mesh", (long)(indices.size() / 3));
+    delete vertexLookup;
+    vertexLookup = NULL;
+    buildTriangles();
+    buildTree();
+}
+
+Mesh::Mesh(const MeshData &data, const uint32_t firstMaterial, const long materialCount, const char* _name): tree(NULL), firstMaterial(firstMaterial), materialCount(materialCount), triangleCount(0), materialBinding(data.materialBinding), normType(data.normType), hasTextureCoords(data.texCoords != NULL), area(0), vertexLookup(NULL){
+    name = _name;
+
+    // Deduplicated by addPolygon() when the cache was written, so the arrays are used as they are.
+    positions.borrow(data.positions, data.vertexCount);
+    if(data.normals != NULL){ vertexNormals.borrow(data.normals, data.vertexCount); }
+    if(data.texCoords != NULL){ texCoords.borrow(data.texCoords, 2 * data.vertexCount); }
+    if(data.materialIndices != NULL){ vertexMaterials.borrow(data.materialIndices, data.vertexCount); }
+    indices.borrow(data.indices, 3 * data.triangleCount);
+}
+
+Mesh::~Mesh(){
+    delete vertexLookup;
+    delete tree;
+}
+
+void Mesh::buildTriangles(){
+    PROFILE_SCOPE("triangles");
+    triangleCount = indices.size() / 3;
+    normals.reserve(triangleCount);
+    // Reserved up front: the kd-tree keeps pointers into this vector.
+    triangleStorage.reserve(triangleCount);
+    triangles.reserve(triangleCount);
+    for(uint32_t i = 0; i < triangleCount; i++){
+        normals.push_back(faceNormal(i));
+        triangleStorage.push_back(Triangle(*this, i));
+        triangles.push_back(&triangleStorage.back());
+    }
+    reportMemory();
+}
+
+void Mesh::reportMemory() const {
+    size_t indexed = positions.size() * sizeof(Pos) + vertexNormals.size() * sizeof(Vec3f)
+        + texCoords.size() * sizeof(float) + vertexMaterials.size() * sizeof(int32_t)
+        + indices.size() * sizeof(uint32_t) + normals.size() * sizeof(Vec3f)
+        + triangleStorage.size() * sizeof(Triangle) + triangles.size() * sizeof(Triangle*);
+    // The previous layout: a heap Triangle per face holding three VertexIO copies, the PolygonIO,
+    // positions, normals, edges and dot products, plus its face normal and pointer.
+    size_t perTriangle = 3 * sizeof(VertexIO) + sizeof(PolygonIO) + 10 * sizeof(Vec3f) + 4 * sizeof(float)
+        + sizeof(Box) + sizeof(Mesh*) + sizeof(Vec3f) + sizeof(Triangle*);
+    size_t copied = triangleCount * perTriangle;
+    std::cout << "Mesh " << (name != NULL ? name : "(unnamed)") << ": " << triangleCount << " triangles, "
+    << positions.size() << " vertices for " << indices.size() << " corners, "
+    << indexed / 1024 << " KB instead of " << copied / 1024 << " KB";
+    if (copied > 0) {
+        std::cout << " (" << (int)(100.0 * indexed / copied) << "%)";
+    }
+    std::cout << std::endl;
+}
+
+void Mesh::buildTree(){
+    PROFILE_SCOPE_VALUE("kd-tree", (long)triangles.size());
     float xmin = INFINITY, ymin = INFINITY, zmin = INFINITY;
     float xmax = -INFINITY, ymax = -INFINITY, zmax = -INFINITY;
+    for (Triangle *t: triangles) {
+        xmin = fmin(xmin, t->bounds.min.x);
+        ymin = fmin(ymin, t->bounds.min.y);
+        zmin = fmin(zmin, t->bounds.min.z);
 
-    for(int i = 0; i < numPolys; i++){
-        PolygonIO polygon = polySet.poly[i];
-        Vec3f N = normal(polygon);
-        normals.push_back(N);
-        normType = polySet.normType;
-        materialBinding = polySet.materialBinding;
-        Triangle* t = new Triangle(polygon, *this, N);
-        triangles.push_back(t);
-
-        xmin = fmin(xmin, fmin(polygon.vert[0].pos[0], fmin(polygon.vert[1].pos[0], polygon.vert[2].pos[0])));
-        ymin = fmin(ymin, fmin(polygon.vert[0].pos[1], fmin(polygon.vert[1].pos[1], polygon.vert[2].pos[1])));
-        zmin = fmin(zmin, fmin(polygon.vert[0].pos[2], fmin(polygon.vert[1].pos[2], polygon.vert[2].pos[2])));
-
-        xmax = fmax(xmax, fmax(polygon.vert[0].pos[0], fmax(polygon.vert[1].pos[0], polygon.vert[2].pos[0])));
-        ymax = fmax(ymax, fmax(polygon.vert[0].pos[1], fmax(polygon.vert[1].pos[1], polygon.vert[2].pos[1])));
-        zmax = fmax(zmax, fmax(polygon.vert[0].pos[2], fmax(polygon.vert[1].pos[2], polygon.vert[2].pos[2])));
+        xmax = fmax(xmax, t->bounds.max.x);
+        ymax = fmax(ymax, t->bounds.max.y);
+        zmax = fmax(zmax, t->bounds.max.z);
     }
     bounds[0] = Vec3f(xmin, ymin, zmin);
     bounds[1] = Vec3f(xmax, ymax, zmax);
-    std::cout << "Building KD-tree for Mesh: " << this << std::endl;
-    Node* root;
-    root = root->RecBuild(triangles, Box(bounds[0], bounds[1]), 0, SplitPlane());
-    node = *root;
-    std::cout << "Finished building kd-tree."<< std::endl;
+    Node* root = KdTreeCache::load(triangles);
+    if (root == NULL) {
+        std::cout << "Building KD-tree for Mesh: " << this << std::endl;
+        root = Node().RecBuild(triangles, Box(bounds[0], bounds[1]), 0, SplitPlane());
+        KdTreeCache::save(triangles, root);
+        std::cout << "Finished building kd-tree."<< std::endl;
+    }
+    tree = root;
 
 }
 
@@ -48,17 +175,68 @@ bool Mesh::intersect(Ray &ray){
 //    for (int i = 0; i < triangleCount ; i++) {
 //        triangles[i]->intersect(ray);
 //    }
-    node.traverse(ray);
+    tree->traverse(ray);
     // Triangle Intersection!
     return ray.t_max < INFINITY;
 }
 
+MaterialIO Mesh::shadingMaterial(const Ray &ray) const {
+    return shadingMaterial(ray, firstMaterial);
+}
+
+MaterialIO Mesh::shadingMaterial(const Ray &ray, const uint32_t firstMaterial) const {
+    if(materialBinding != PER_VERTEX_MATERIAL){
+        return materialTable[ray.materialId];
+    }
+    const Triangle &triangle = triangleStorage[ray.primitiveIndex];
+    return triangle.interpolate(ray.u, ray.v,
+                                materialTable[firstMaterial + vertexMaterials[triangle.vertexIndex(0)]],
+                                materialTable[firstMaterial + vertexMaterials[triangle.vertexIndex(1)]],
+                                materialTable[firstMaterial + vertexMaterials[triangle.vertexIndex(2)]]);
+}
+
+
+
+void Mesh::textureCoords(const Ray &ray, float &s, float &t) const {
+    if(!hasTextureCoords){
+        Primitive::textureCoords(ray, s, t);
+        return;
+    }
+    const Triangle &triangle = triangleStorage[ray.primitiveIndex];
+    const float *st0 = &texCoords[2 * triangle.vertexIndex(0)];
+    const float *st1 = &texCoords[2 * triangle.vertexIndex(1)];
+    const float *st2 = &texCoords[2 * triangle.vertexIndex(2)];
+    float w = 1.0 - (ray.u + ray.v);
+    s = st1[0]*ray.u + st2[0]*ray.v + st0[0]*w;
+    t = st1[1]*ray.u + st2[1]*ray.v + st0[1]*w;
+}
+
+/* Built once at load for emissive meshes, so lights never walk their triangles per sample. */
+void Mesh::buildLightDistribution(){
+    std::vector<float> areas;
+    areas.reserve(triangles.size());
+    for (Triangle *triangle: triangles) {
+        areas.push_back(triangle->area());
+    }
+    triangleDistribution.build(areas);
+    area = triangleDistribution.total();
+}
 
+Pos Mesh::samplePoint(const float u1, const float u2, Vec3f &N) const {
+    float r1;
+    int index = triangleDistribution.sample(u1, r1);
+    const Triangle &triangle = triangleStorage[index];
+    N = normals[index];
+    // Uniform barycentrics without rejection: fold the square onto the triangle with a square root.
+    float su = sqrt(r1);
+    const Pos &p0 = triangle.position(0);
+    return p0 + (triangle.position(1) - p0) * (su * (1.0 - u2)) + (triangle.position(2) - p0) * (su * u2);
+}
 
-Vec3f Mesh::normal(const PolygonIO polygon) const {
-    Pos a = Pos(polygon.vert[0].pos);
-    Pos b = Pos(polygon.vert[1].pos);
-    Pos c = Pos(polygon.vert[2].pos);
+Vec3f Mesh::faceNormal(const uint32_t triangle) const {
+    Pos a = positions[indices[3*triangle]];
+    Pos b = positions[indices[3*triangle + 1]];
+    Pos c = positions[indices[3*triangle + 2]];
     Vec3f ab = Vec3f::normalize((b-a));
     Vec3f ac = Vec3f::normalize((c-a));
     Vec3f N = Vec3f::normalize(Vec3f::cross(ab, ac));
@@ -67,11 +245,35 @@ Vec3f Mesh::normal(const PolygonIO polygon) const {
 
 #pragma mark - Triangle stuff
 
-float Triangle::area(){
-    return Vec3f::cross(u, v).length() * 0.5;
+Triangle::Triangle(Mesh &mesh, uint32_t index): parentMesh(mesh), index(index){
+    bounds = getBounds();
+}
+
+float Triangle::leftExtreme(int axis) const {
+    return fmin(position(0)[axis], fmin(position(1)[axis], position(2)[axis]));
+}
+
+float Triangle::rightExtreme(int axis) const {
+    return fmax(position(0)[axis], fmax(position(1)[axis], position(2)[axis]));
+}
+
+Box Triangle::getBounds() const {
+    return Box(Vec3f(leftExtreme(0), leftExtreme(1), leftExtreme(2)), Vec3f(rightExtreme(0), rightExtreme(1), rightExtreme(2)));
+}
+
+float Triangle::area() const {
+    const Pos &p0 = position(0);
+    return Vec3f::cross(position(1) - p0, position(2) - p0).length() * 0.5;
 }
 
 bool Triangle::intersect(Ray &ray) const{
+    RAY_STAT(trianglesTested);
+    // Edges and normal come from the shared vertices instead of being stored per triangle.
+    const Pos &p0 = position(0);
+    Vec3f u = position(1) - p0;
+    Vec3f v = position(2) - p0;
+    Vec3f n = Vec3f::cross(v, u);
+
     // First check for plane intersection
     Vec3f w0 = p0 - ray.startPosition;
     float r1 = Vec3f::dot(n, w0);
@@ -88,6 +290,10 @@ bool Triangle::intersect(Ray &ray) const{
 
     // Plane intersection confirmed. Check if we are inside the triangle:
 
+    float uu = Vec3f::dot(u,u);
+    float uv = Vec3f::dot(u,v);
+    float vv = Vec3f::dot(v,v);
+    float invDenom = 1.0 / (uv*uv - uu*vv);
     Pos intersectionPoint = ray.startPosition + ray.direction * r;
     Pos w = intersectionPoint - p0;
     float uw = Vec3f::dot(u, w);
@@ -97,27 +303,30 @@ bool Triangle::intersect(Ray &ray) const{
     if (s < 0.0f || t < 0.0f || s + t > 1.0f){ return false; } // Outside triangle
                                                                // Triangle Intersection!
     if (r < ray.t_max) {
+        RAY_STAT(trianglesHit);
         ray.currentObject = &parentMesh;
         ray.t_max= r;
         ray.u = s;
         ray.v = t;
         Vec3f normalAtIntersectionPoint;
         if(parentMesh.normType == PER_VERTEX_NORMAL){
-             normalAtIntersectionPoint = interpNormals(s, t, n0, n1, n2);
+            const MeshArray<Vec3f> &vertexNormals = parentMesh.vertexNormals;
+            normalAtIntersectionPoint = interpNormals(s, t, vertexNormals[vertexIndex(0)], vertexNormals[vertexIndex(1)], vertexNormals[vertexIndex(2)]);
 
         } else {
-            normalAtIntersectionPoint = provided_n;
+            normalAtIntersectionPoint = parentMesh.normals[index];
         }
         // If we hit the backside of the triangle, flip the normal.
         float dot = Vec3f::dot(normalAtIntersectionPoint, ray.direction);
         int behindFactor = (dot < 0) - (dot > 0); // 1 if we are behind, -1 otherwise.
         ray.intersectionNormal = normalAtIntersectionPoint * behindFactor;
 
+        // Per-vertex materials are interpolated only for the hit that gets shaded, see Mesh::shadingMaterial.
+        ray.materialId = parentMesh.firstMaterial;
         if(parentMesh.materialBinding == PER_VERTEX_MATERIAL){
-            ray.material = interpolate(s, t, v0, v1, v2);
-        } else {
-            ray.material = parentMesh.materials[0];
+            ray.materialId += parentMesh.vertexMaterials[vertexIndex(0)];
         }
+        ray.primitiveIndex = index;
     }
 
     return ray.t_max < INFINITY;
@@ -127,11 +336,8 @@ Vec3f Triangle::interpNormals(const float u, const float v, const Vec3f &n1, con
     float w = 1.0 - (u+v);
     return n2*u + n3*v + n1*w;
 }
-MaterialIO Triangle::interpolate(const float u,const float v,const VertexIO &v1, const VertexIO &v2, const VertexIO &v3) const {
+MaterialIO Triangle::interpolate(const float u,const float v,const MaterialIO &m1, const MaterialIO &m2, const MaterialIO &m3) const {
     MaterialIO result;
-    MaterialIO m1 = parentMesh.materials[v1.materialIndex];
-    MaterialIO m2 = parentMesh.materials[v2.materialIndex];
-    MaterialIO m3 = parentMesh.materials[v3.materialIndex];
     float w = 1.0 - (u+v);
 
     result.ktran = u*m2.ktran + v*m3.ktran + w*m1.ktran;
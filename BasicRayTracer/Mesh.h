@@ -10,27 +10,112 @@
 #define __BasicRayTracer__Mesh__
 
 #include <stdio.h>
+#include <stdint.h>
 #include <vector>
 #include "Primitive.h"
 #include "scene_io.h"
 #include "box_triangle.h"
 #include "kdTree.h"
+#include "AliasTable.h"
 
 class Mesh;
 
+/* Indexed triangle data that the mesh reads in place, e.g. a mapped scene cache. */
+struct MeshData {
+    const Pos *positions;
+    const Vec3f *normals;           // Normalized, PER_VERTEX_NORMAL only
+    const float *texCoords;         // s, t pairs, NULL without texture coordinates
+    const int32_t *materialIndices; // 1 per vertex, PER_VERTEX_MATERIAL only
+    const uint32_t *indices;        // 3 per triangle
+    long vertexCount;
+    long triangleCount;
+    NormType normType;
+    MaterialBinding materialBinding;
+};
+
+/* A vertex attribute or index array that the mesh either fills itself, or borrows from
+   memory that outlives it. Reads go through the same pointer either way. */
+template <typename T>
+class MeshArray {
+public:
+    MeshArray():items(NULL), count(0){};
+    MeshArray(const MeshArray &) = delete;
+    MeshArray& operator=(const MeshArray &) = delete;
+
+    void push_back(const T &item){ owned.push_back(item); items = &owned[0]; count = owned.size(); }
+    void borrow(const T *data, const size_t size){ std::vector<T>().swap(owned); items = data; count = size; }
+    const T& operator[](const size_t i) const { return items[i]; }
+    const T* data() const { return items; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+private:
+    std::vector<T> owned;
+    const T *items;
+    size_t count;
+};
+
 class Mesh : public Primitive {
 public:
-    Node node;
-    std::vector<Triangle*> triangles;
-    std::vector<Vec3f> normals;
-    std::vector<MaterialIO> materials;
+    Node *tree;                     // Built by finish(), owned by the mesh
+    uint32_t firstMaterial;         // In the scene's MaterialTable; the mesh's materials follow it
+    long materialCount;
     long triangleCount;
     MaterialBinding materialBinding;
     NormType normType;
-    Mesh(const PolySetIO polySet, const MaterialIO* materials, const long materialCount, char* name);
+    bool hasTextureCoords;
+
+    // Deduplicated vertices, one array per attribute. Attributes the mesh doesn't use stay empty.
+    MeshArray<Pos> positions;
+    MeshArray<Vec3f> vertexNormals;         // PER_VERTEX_NORMAL, normalized at load
+    MeshArray<float> texCoords;             // s, t pairs, hasTextureCoords
+    MeshArray<int32_t> vertexMaterials;     // PER_VERTEX_MATERIAL
+    MeshArray<uint32_t> indices;            // 3 per triangle
+    std::vector<Vec3f> normals;             // Per triangle
+    std::vector<Triangle> triangleStorage;
+    std::vector<Triangle*> triangles;       // Into triangleStorage, for the kd-tree
+
+    // Emitters only: total area and a per-triangle area distribution, see buildLightDistribution().
+    float area;
+    AliasTable triangleDistribution;
+
+    Mesh(const PolySetIO polySet, const uint32_t firstMaterial, const long materialCount, const char* name);
+    // Empty mesh for streamed loading: addPolygon() each polygon in order, then finish().
+    Mesh(const NormType normType, const MaterialBinding materialBinding, const bool hasTextureCoords, const uint32_t firstMaterial, const long materialCount, const char* name);
+    // Borrows the arrays, which have to outlive the mesh; finish() builds the triangles and tree.
+    Mesh(const MeshData &data, const uint32_t firstMaterial, const long materialCount, const char* name);
+    ~Mesh();
+
+    void addPolygon(const VertexIO *vertices, const long vertexCount);
+    void finish();
 
     virtual bool intersect(Ray &ray);
-    Vec3f normal(const PolygonIO polygon) const;
+    virtual MaterialIO shadingMaterial(const Ray &ray) const;
+    // As shaded with the materials starting at `firstMaterial`, for instances of the mesh.
+    MaterialIO shadingMaterial(const Ray &ray, const uint32_t firstMaterial) const;
+    // Interpolated from the corners' s, t when the mesh has them, otherwise the barycentrics.
+    virtual void textureCoords(const Ray &ray, float &s, float &t) const;
+
+    void buildLightDistribution();
+    // Uniformly distributed point on the surface (pdf 1/area), and the normal of its triangle.
+    Pos samplePoint(const float u1, const float u2, Vec3f &normal) const;
+
+private:
+    struct VertexLookup;
+    VertexLookup *vertexLookup;     // Only while polygons are being added
+
+    Vec3f faceNormal(const uint32_t triangle) const;
+    void buildTriangles();
+    void buildTree();
+    void reportMemory() const;
 
 };
+
+inline uint32_t Triangle::vertexIndex(const int corner) const {
+    return parentMesh.indices[3*index + corner];
+}
+
+inline const Pos& Triangle::position(const int corner) const {
+    return parentMesh.positions[vertexIndex(corner)];
+}
+
 #endif /* defined(__BasicRayTracer__Mesh__) */
@@ -5,6 +5,8 @@
 //  Created by Arve Nygård on 19/03/15.
 
 #include "PhotonMap.h"
+#include "RayStats.h"
+#include "Profiler.h"
 #define DIMENSIONS 3
 void PhotonMap::store(const Photon &photon){
     photons.push_back(photon);
@@ -12,6 +14,7 @@ void PhotonMap::store(const Photon &photon){
 
 /* Turn the list of photons into a KD-tree. Make sure you run this before attempting to *use* the tree. */
 void PhotonMap::build(){
+    PROFILE_SCOPE_VALUE("photon balance", (long)photons.size());
     std::vector<Photon*> photonPointerList = std::vector<Photon*>();
     for( Photon &p : photons){
         photonPointerList.push_back(&p);
@@ -81,6 +84,7 @@ PNode * PhotonMap::buildTree(std::vector<Photon*> photonList, int depth){
 
 std::priority_queue<Result> PhotonMap::kNN(const Pos query, const int k){
     int touched_nodes = 0;
+    RAY_STAT(photonQueries);
     // Max-heap, sorted by distance.
     std::priority_queue<Result> heap = std::priority_queue<Result>();
     // dummy result seed.
@@ -107,6 +111,7 @@ void PhotonMap::nearest(const PNode *root, const Pos &query, int &visited, const
     dx2 = dx * dx;
 
     visited ++;
+    RAY_STAT(photonsVisited);
     if (d < heap.top().dx) { // worst distance from query currently in prio queue
         // Insert this, kicking out the lowest one if neccessary.
         Result r = Result(root->photon, d);
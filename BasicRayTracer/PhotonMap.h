@@ -48,8 +48,9 @@ private:
     PNode* kdtree;
     void nearest(const PNode *root, const Pos &query, int &visited, const int k, std::priority_queue<Result> &heap);
 public:
-    PhotonMap():photons(std::vector<Photon>()){}
+    PhotonMap():photons(std::vector<Photon>()), kdtree(NULL){}
     void store(const Photon &photon);
+    bool empty() const { return kdtree == NULL; }
     void build();
     PNode* buildTree(std::vector<Photon*> photonList, int depth);
     std::priority_queue<Result> kNN(const Pos position, const int k);
@@ -1,4 +1,6 @@
 #include "Primitive.h"
+#include "MaterialTable.h"
+extern MaterialTable materialTable;
 
 /* Fast bounding box intersection
  http://www.cs.utah.edu/~awilliam/box/box.pdf
@@ -23,7 +25,16 @@ bool Primitive::bboxIntersect(Ray &r){
     return  tmax > 0;
 }
 
-Primitive::Primitive()
+MaterialIO Primitive::shadingMaterial(const Ray &ray) const {
+    return materialTable[ray.materialId];
+}
+
+void Primitive::textureCoords(const Ray &ray, float &s, float &t) const {
+    s = ray.u;
+    t = ray.v;
+}
+
+Primitive::Primitive():shader(NULL)
 {
 }
 
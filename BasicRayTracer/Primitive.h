@@ -5,11 +5,16 @@
 class Primitive {
 public:
     const char* name;
+    surface_shader shader;      // Resolved from the name at load, NULL for none
     Vec3f bounds[2];
 	Primitive();
-	~Primitive();
+	virtual ~Primitive();
     bool bboxIntersect(Ray &ray);
 	virtual bool intersect(Ray &ray) = 0;
+    // The material to shade `ray`'s hit on this primitive with.
+    virtual MaterialIO shadingMaterial(const Ray &ray) const;
+    // Where surface shaders place their patterns: the hit's u, v unless the primitive has its own.
+    virtual void textureCoords(const Ray &ray, float &s, float &t) const;
 };
 
 #endif
\ No newline at end of file
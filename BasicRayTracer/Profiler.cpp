@@ -0,0 +1,142 @@
+//
+//  Profiler.cpp
+//  BasicRayTracer
+//
+
+#include "Profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+
+bool Profiler::enabled = false;
+
+namespace {
+
+struct Event {
+    const char *name;
+    long value;         // -1 for none
+    uint64_t start;
+    uint64_t end;
+};
+
+/* One thread's ring. It stays in the registry after the thread exits, so short-lived
+   threads, like the parser's, still show up in the trace. */
+struct ThreadEvents {
+    int id;
+    std::string name;
+    std::vector<Event> ring;    // Grows up to PROFILER_RING_EVENTS, then wraps
+    uint64_t recorded;          // Events ever recorded
+};
+
+std::mutex registryMutex;
+std::vector<ThreadEvents*> threads;
+std::chrono::steady_clock::time_point epoch;
+
+ThreadEvents* registerThread(){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    ThreadEvents *events = new ThreadEvents();
+    events->id = (int)threads.size();
+    events->name = events->id == 0 ? "main" : "thread " + std::to_string(events->id);
+    events->recorded = 0;
+    threads.push_back(events);
+    return events;
+}
+
+ThreadEvents& localEvents(){
+    thread_local ThreadEvents *events = registerThread();
+    return *events;
+}
+
+std::string escaped(const std::string &text){
+    std::string out;
+    for (char c: text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+}
+
+void Profiler::enable(){
+    epoch = std::chrono::steady_clock::now();
+    localEvents();      // The enabling thread is "main"
+    enabled = true;
+}
+
+void Profiler::nameThread(const char *name){
+    if (enabled) {
+        ThreadEvents &events = localEvents();
+        events.name = std::string(name) + " " + std::to_string(events.id);
+    }
+}
+
+uint64_t Profiler::now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const char *name, const long value, const uint64_t start, const uint64_t end){
+    ThreadEvents &events = localEvents();
+    Event event = { name, value, start, end };
+    if (events.ring.size() < PROFILER_RING_EVENTS) {
+        events.ring.push_back(event);
+    } else {
+        events.ring[events.recorded % PROFILER_RING_EVENTS] = event;
+    }
+    events.recorded++;
+}
+
+double Profiler::seconds(const char *name, const uint64_t since){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    uint64_t total = 0;
+    for (ThreadEvents *events: threads) {
+        for (const Event &event: events->ring) {
+            if (event.start >= since && strcmp(event.name, name) == 0) {
+                total += event.end - event.start;
+            }
+        }
+    }
+    return total / 1e9;
+}
+
+bool Profiler::write(const char *filename){
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Can't open file '%s' for writing.\n", filename);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(registryMutex);
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    uint64_t dropped = 0;
+    for (ThreadEvents *events: threads) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",\n", events->id, escaped(events->name).c_str());
+        first = false;
+        uint64_t count = events->recorded < PROFILER_RING_EVENTS ? events->recorded : PROFILER_RING_EVENTS;
+        dropped += events->recorded - count;
+        for (uint64_t i = events->recorded - count; i < events->recorded; i++) {
+            const Event &event = events->ring[i % PROFILER_RING_EVENTS];
+            // Chrome wants microseconds.
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    event.name, events->id, event.start / 1000.0, (event.end - event.start) / 1000.0);
+            if (event.value >= 0) {
+                fprintf(file, ", \"args\": {\"value\": %ld}", event.value);
+            }
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Wrote trace %s", filename);
+    if (dropped > 0) {
+        printf(" (%llu oldest events overwritten)", (unsigned long long)dropped);
+    }
+    printf("\n");
+    return true;
+}
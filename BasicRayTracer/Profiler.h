@@ -0,0 +1,61 @@
+//
+//  Profiler.h
+//  BasicRayTracer
+//
+//  Scoped timing for the load and render timeline. PROFILE_SCOPE("name") times
+//  the rest of the enclosing block. Each thread records into its own ring buffer
+//  of the last PROFILER_RING_EVENTS scopes, so recording takes no locks; when a
+//  ring is full its oldest events are overwritten.
+//
+//  Profiling is off until Profiler::enable(), so an idle scope costs one test.
+//  Profiler::write() saves everything recorded as Chrome trace JSON, for
+//  chrome://tracing or ui.perfetto.dev: one track per thread, with nested scopes
+//  stacked, which shows startup, the render and how busy each thread was.
+//
+//  Names must be string literals or otherwise outlive the profiler.
+//
+
+#ifndef __BasicRayTracer__Profiler__
+#define __BasicRayTracer__Profiler__
+
+#include <stdint.h>
+
+#define PROFILER_RING_EVENTS 65536
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+// A scope with a number attached, e.g. the triangle count of the mesh being built.
+#define PROFILE_SCOPE_VALUE(name, value) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, value)
+
+class Profiler {
+public:
+    static bool enabled;
+
+    static void enable();
+    // Names the calling thread's track in the trace.
+    static void nameThread(const char *name);
+    // Nanoseconds since enable().
+    static uint64_t now();
+    static void record(const char *name, const long value, const uint64_t start, const uint64_t end);
+    // Total seconds spent in scopes called `name` that started at or after `since`, on every thread.
+    static double seconds(const char *name, const uint64_t since);
+    // Saves every thread's events. Only complete while no thread is recording.
+    static bool write(const char *filename);
+};
+
+class ProfileScope {
+private:
+    const char *name;
+    long value;
+    uint64_t start;
+public:
+    ProfileScope(const char *name, const long value = -1):name(name), value(value), start(Profiler::enabled ? Profiler::now() : 0){};
+    ~ProfileScope(){
+        if (Profiler::enabled) {
+            Profiler::record(name, value, start, Profiler::now());
+        }
+    }
+};
+
+#endif /* defined(__BasicRayTracer__Profiler__) */
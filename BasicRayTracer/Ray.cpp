@@ -2,19 +2,27 @@
 #include "Sphere.h"
 #include "Mesh.h"
 #include "PhotonMap.h"
+#include "EnvironmentMap.h"
+#include "MaterialTable.h"
+#include "RayStats.h"
+#include "Profiler.h"
+#include "SampleStream.h"
 #define INV_SQRT_3 0.577350269
-extern void defaultShader(Ray &ray);
+extern MaterialTable materialTable;
 extern SceneIO *scene;
 extern std::vector<Primitive*> objects;
 extern std::vector<Mesh*> areaLights;
+extern AliasTable lightDistribution;
 extern std::vector<LightIO*> lights;
 extern PhotonMap pMap;
-size_t Ray::counter = 0;
+extern EnvironmentMap *environment;
+thread_local size_t Ray::counter = 0;
 
 #define GLOBAL_PHOTON_COUNT 1000000
 
+/* The next number from the current sample's stream, see SampleStream.h. */
 float randf(){
-    return ((float)rand()/(float)RAND_MAX);
+    return SampleStream::next();
 }
 
 float sgn(float x){
@@ -29,7 +37,6 @@ inv_direction(Vec3f(1.0/direction.x, 1.0/direction.y, 1.0/direction.z))
     sign[0] = (inv_direction.x < 0);
     sign[1] = (inv_direction.y < 0);
     sign[2] = (inv_direction.z < 0);
-    surfaceShader = defaultShader;
     t_max = INFINITY;
     color = BACKGROUND_COLOR;
 }
@@ -38,7 +45,13 @@ Pos Ray::intersectionPoint() const {
     return startPosition + direction * t_max;
 }
 
+/* A copy of the hit's material for shading, so shaders can change it without touching the table. */
+MaterialIO Ray::shadingMaterial() const {
+    return currentObject->shadingMaterial(*this);
+}
+
 Colr Ray::trace(int bounces){
+    RAY_STAT(rays[CAMERA_RAY]);
     return pathTrace(bounces, std::unordered_set<Primitive*>());
 }
 
@@ -75,24 +88,11 @@ Vec3f Ray::cosineSampleHemisphere(const Vec3f &direction){
 
     }
 
-Pos randomPointOnTriangle(const Mesh* mesh){
-    Triangle triangle = *mesh->triangles[rand()%mesh->triangles.size()];
-    float r1 = 1.0, r2 = 1.0;
-    // Annoying rejection sampling :(
-    while(r1 + r2 > 1.0){
-        r1 = randf();
-        r2 = randf();
-    }
-    Colr result = triangle.p0 + triangle.u * r1 + triangle.v * r2;
-    return result;
-}
-
-float surfaceArea(const Mesh* mesh){
-    float area = 0;
-    for (auto triangle: mesh->triangles){
-        area += triangle->area();
-    }
-    return area;
+/* Pick an emitter proportional to its power, using the distribution built at load. */
+Mesh* sampleLight(float &pdf){
+    int index = lightDistribution.sample(randf());
+    pdf = lightDistribution.pdf(index);
+    return areaLights[index];
 }
 
 float attenuationFactorAreaLight(const float distance) {
@@ -105,19 +105,29 @@ float attenuationFactorAreaLight(const float distance) {
 
 
 PhotonMap Ray::buildPhotonMap(){
-    std::cout << "Generating Global Photon map (" << GLOBAL_PHOTON_COUNT << " photons)..." << std::endl;
     PhotonMap photonMap = PhotonMap();
-    
-    for ( int i = 0; i < GLOBAL_PHOTON_COUNT; i++){
-        Mesh * light = areaLights[random()%areaLights.size()];
-        float LightSurfaceArea = surfaceArea(light);
-        Colr color = light->materials[0].emissColor;
-        color = color * (LightSurfaceArea / (float)GLOBAL_PHOTON_COUNT);
-        Pos origin = randomPointOnTriangle(light);
-        Vec3f direction = uniformSampleHemisphere(Vec3f(light->normals[0]) * -1.0);
-
-        Ray r = Ray(origin, direction);
-        r.photonTrace(color, photonMap, 10);
+    if (areaLights.empty()) {
+        std::cout << "No area lights, skipping the photon map." << std::endl;
+        return photonMap;
+    }
+    std::cout << "Generating Global Photon map (" << GLOBAL_PHOTON_COUNT << " photons)..." << std::endl;
+
+    {
+        PROFILE_SCOPE_VALUE("photon emission", GLOBAL_PHOTON_COUNT);
+        for ( int i = 0; i < GLOBAL_PHOTON_COUNT; i++){
+            SampleStream::beginPhoton(i);
+            float lightPdf;
+            Mesh * light = sampleLight(lightPdf);
+            // A Lambertian emitter's power is pi * radiance * area, spread over the cosine lobe.
+            Colr color = materialTable[light->firstMaterial].emissColor;
+            color = color * (M_PI * light->area / (lightPdf * (float)GLOBAL_PHOTON_COUNT));
+            Vec3f lightNormal;
+            Pos origin = light->samplePoint(randf(), randf(), lightNormal);
+            Vec3f direction = cosineSampleHemisphere(lightNormal * -1.0);
+
+            Ray r = Ray(origin, direction);
+            r.photonTrace(color, photonMap, PHOTON_MAX_BOUNCES);
+        }
     }
     photonMap.build();
 
@@ -126,70 +136,108 @@ PhotonMap Ray::buildPhotonMap(){
 
 void Ray::photonTrace(Colr flux, PhotonMap &photonMap, const int bounces){
     if(bounces <= 0){ return; }
+    RAY_STAT(rays[PHOTON_RAY]);
     for ( Primitive* object : objects ) {
         object->intersect(*this);
     }
     if(t_max == INFINITY){ // No hit.
         return;
     }
+    MaterialIO material = shadingMaterial();
 
     /* Diffuse + specular should sum to max 1. */
     float diffuseProb = Colr(material.diffColor).length() * INV_SQRT_3;
-    float specularProb = Colr(material.specColor).length() * INV_SQRT_3;
-    float absorbProb = 1.0 - diffuseProb + specularProb;
-    float transProb = material.ktran;
+    float specularProb = specularImportance(material);
+    float transProb = transmissionImportance(material);
+    float absorbProb = fmax(0.0f, 1.0f - (diffuseProb + specularProb + transProb));
+    float albedo = fmin(1.0f, 1.0f - absorbProb);
+
+    // Diffuse surfaces keep the flux that arrives. First hits are direct light, which
+    // pathTrace() samples itself, see directLight().
+    int depth = PHOTON_MAX_BOUNCES - bounces;
+    if (diffuseProb > 0 && depth > 0) {
+        Photon p = Photon(intersectionPoint(), direction, flux);
+        photonMap.store(p);
+    }
+
+    // Russian roulette on the albedo, then one of the surviving photon's events by its share
+    // of it. Scaling by albedo / survival keeps the expected flux of every event as it was.
+    float survival;
+    if (albedo <= 0 || !russianRoulette(depth, PHOTON_RR_MIN_DEPTH, albedo, PHOTON_RR_MIN_SURVIVAL, PHOTON_RR_MAX_SURVIVAL, survival)) {
+        return;
+    }
+    flux = flux * (albedo / survival);
 
-    float r = randf();
+    float r = randf() * (diffuseProb + specularProb + transProb);
     if (r < transProb){
         refractionRay(intersectionPoint(), IOR_AIR, IOR_GLASS).photonTrace(flux, photonMap, bounces-1);
         return;
     }
 
-    if( r < diffuseProb){
+    if( r < transProb + diffuseProb){
         //diffuse
-        Photon p = Photon(intersectionPoint(), direction, flux);
-        photonMap.store(p);
         Vec3f newDirection = cosineSampleHemisphere(intersectionNormal);
-        Colr newFlux = flux * Vec3f(material.diffColor).normalizeColor();
+        Colr newFlux = flux * Colr(material.diffColor) * (1.0 / diffuseProb);
         Ray(intersectionPoint(), newDirection).photonTrace(newFlux, photonMap, bounces-1);
     }
-    else if ( r < diffuseProb + specularProb){
-        reflectionRay(intersectionPoint()).photonTrace(flux, photonMap, bounces-1);
-    }
     else {
-        //absorb
-        return;
+        reflectionRay(intersectionPoint()).photonTrace(flux, photonMap, bounces-1);
     }
 }
 
+bool russianRoulette(const int depth, const int minDepth, const float importance, const float minSurvival, const float maxSurvival, float &survival){
+    survival = depth < minDepth ? 1 : fmin(fmax(importance, minSurvival), maxSurvival);
+    return survival >= 1 || randf() < survival;
+}
+
+float specularImportance(const MaterialIO &material){
+    return Colr(material.specColor).length() * INV_SQRT_3;
+}
+
+float transmissionImportance(const MaterialIO &material){
+    return material.ktran;
+}
+
 Colr computeRadiance(const Pos &point, const Vec3f &normal, const int numPoints){
+    if (pMap.empty()) { return Colr(0,0,0); }
     std::priority_queue<Result> photons = pMap.kNN(point, numPoints);
-    float radius = photons.top().dx;
+    float radiusSquared = photons.top().dx;
 
 
-    Colr radiance = Colr(0,0,0);
+    // Irradiance is the flux of the photons that arrive from the front over the disc they
+    // cover, and a white Lambertian surface reflects 1/pi of it as radiance.
+    Colr flux = Colr(0,0,0);
     while(!photons.empty()){
         Photon p = *(photons.top().photon);
-        Vec3f incident = p.incidentDirection;
-        radiance += p.flux * fmax(0, Vec3f::dot(incident, normal));
+        if (Vec3f::dot(p.incidentDirection, normal) > 0) {
+            flux += p.flux;
+        }
         photons.pop();
     }
-    return radiance * (1.0/ radius);
+    return flux * (M_1_PI * M_1_PI / radiusSquared);
 }
 
-Colr Ray::pathTrace(int bounces, std::unordered_set<Primitive*> insideObjects){
+/* Radiance along the ray. `depth` counts the reflections and refractions that led here, and
+   `importance` is the product of their specularImportance() and transmissionImportance():
+   reflected and transmitted light is added at full strength, so it is the materials, not the
+   path's weight, that say how much light the path would still carry. Russian roulette on
+   it ends paths past PATH_RR_MIN_DEPTH. */
+Colr Ray::pathTrace(int bounces, std::unordered_set<Primitive*> insideObjects, const int depth, const float importance){
     Colr result = Colr(0,0,0);
     if(bounces < 0){ return result; }
     for ( Primitive* object : objects ) {
         object->intersect(*this);
     }
     if(t_max == INFINITY){ // No hit.
-        return BACKGROUND_COLOR;
+        return background();
     }
+    MaterialIO material = shadingMaterial();
     if(material.emissColor[0] > 0){
         return Colr(material.emissColor);
     }
-    defaultShader(*this);
+    if(currentObject->shader != NULL){
+        currentObject->shader(*this, material);
+    }
 
 
     Colr diffuse, reflected, transmitted;
@@ -197,11 +245,30 @@ Colr Ray::pathTrace(int bounces, std::unordered_set<Primitive*> insideObjects){
 
     Colr radiance = computeRadiance(intersectionPoint(), intersectionNormal, 200);
     diffuse = Vec3f(material.diffColor) * radiance;
-    if (material.specColor[0] > 0){
+    if (environment != NULL) {
+        diffuse += environmentLight(material);
+    }
+    if (!areaLights.empty()) {
+        diffuse += directLight(material);
+    }
+
+    // Both paths are decided before either is traced, and each gets a stream of its own,
+    // so the wavefront renderer, which traces them later, makes the same decisions.
+    float reflectImportance = importance * specularImportance(material);
+    float refractImportance = importance * transmissionImportance(material);
+    float reflectSurvival, refractSurvival;
+    bool reflect = material.specColor[0] > 0 && bounces - 1 >= 0
+    && russianRoulette(depth, PATH_RR_MIN_DEPTH, reflectImportance, PATH_RR_MIN_SURVIVAL, PATH_RR_MAX_SURVIVAL, reflectSurvival);
+    bool refract = material.ktran > 0 && bounces - 2 >= 0
+    && russianRoulette(depth, PATH_RR_MIN_DEPTH, refractImportance, PATH_RR_MIN_SURVIVAL, PATH_RR_MAX_SURVIVAL, refractSurvival);
+    const SampleStream stream = SampleStream::current();
+
+    if (reflect){
         // Specular reflection
-        reflected = reflection(intersectionPoint(), bounces-1, insideObjects);
+        SampleStream::resume(stream.split(0));
+        reflected = reflection(intersectionPoint(), bounces-1, insideObjects, depth + 1, reflectImportance) * (1.0 / reflectSurvival);
     }
-    if (material.ktran > 0) {
+    if (refract) {
 
         //refraction
         // Transmitted
@@ -220,14 +287,72 @@ Colr Ray::pathTrace(int bounces, std::unordered_set<Primitive*> insideObjects){
         }
         float ior_a = isInside ? IOR_GLASS : IOR_AIR;
         float ior_b = mySet.size() != 0 ? IOR_GLASS : IOR_AIR;
-        transmitted = refraction(intersectionPoint(), bounces-1, ior_a, ior_b, insideObjects, insideObjects);
+        SampleStream::resume(stream.split(1));
+        transmitted = refraction(intersectionPoint(), bounces-1, ior_a, ior_b, insideObjects, insideObjects, depth + 1, refractImportance) * (1.0 / refractSurvival);
     }
     return diffuse + reflected + transmitted;
 }
 
 
 
-Colr Ray::indirectLight(const Vec3f dir, const int bounces, const std::unordered_set<Primitive*> insideObjects){
+Colr Ray::background() const {
+    if (environment == NULL) {
+        return BACKGROUND_COLOR;
+    }
+    return environment->lookup(direction);
+}
+
+float powerHeuristic(const float pdfA, const float pdfB){
+    return (pdfA * pdfA) / (pdfA * pdfA + pdfB * pdfB);
+}
+
+/* Direct light from the environment map at the current hit, for a diffuse surface.
+   One sample from the map's luminance distribution and one cosine-weighted BSDF sample,
+   combined with the power heuristic. The photon map only carries area-light photons,
+   so this does not double count. */
+Colr Ray::environmentLight(const MaterialIO &material) const {
+    Colr result = Colr(0,0,0);
+    Vec3f directions[2];
+    Colr contributions[2];
+    int count = environmentSamples(material, directions, contributions);
+    for (int i = 0; i < count; i++) {
+        result += contributions[i] * shadow(directions[i], INFINITY);
+    }
+    return result;
+}
+
+/* environmentLight()'s samples before their shadow rays: the directions to test, and what
+   each adds if nothing is in the way. */
+int Ray::environmentSamples(const MaterialIO &material, Vec3f directions[2], Colr contributions[2]) const {
+    int count = 0;
+    Colr albedo = Colr(material.diffColor) * (1.0 - material.ktran);
+
+    // Light sample.
+    Vec3f wi;
+    float lightPdf;
+    Colr Le = environment->sample(randf(), randf(), wi, lightPdf);
+    float cosTheta = Vec3f::dot(wi, intersectionNormal);
+    if (lightPdf > 0 && cosTheta > 0) {
+        float bsdfPdf = cosTheta * M_1_PI;
+        float weight = powerHeuristic(lightPdf, bsdfPdf);
+        directions[count] = wi;
+        contributions[count++] = albedo * Le * (M_1_PI * cosTheta * weight / lightPdf);
+    }
+
+    // BSDF sample. f * cos / pdf is just the albedo for a cosine-sampled Lambertian.
+    wi = cosineSampleHemisphere(intersectionNormal);
+    cosTheta = Vec3f::dot(wi, intersectionNormal);
+    if (cosTheta > 0) {
+        float bsdfPdf = cosTheta * M_1_PI;
+        float weight = powerHeuristic(bsdfPdf, environment->pdf(wi));
+        directions[count] = wi;
+        contributions[count++] = albedo * environment->lookup(wi) * weight;
+    }
+    return count;
+}
+
+Colr Ray::indirectLight(const MaterialIO &material, const Vec3f dir, const int bounces, const std::unordered_set<Primitive*> insideObjects){
+    RAY_STAT(rays[INDIRECT_RAY]);
     Ray indirectray = Ray(intersectionPoint(), dir);
     Colr indirectLight = indirectray.pathTrace(bounces-1, insideObjects) * Colr(material.diffColor);
 
@@ -237,23 +362,89 @@ Colr Ray::indirectLight(const Vec3f dir, const int bounces, const std::unordered
 }
 
 
-Colr Ray::directLight(){
-    Colr diffuseColor;
-    Mesh * light = areaLights[random()%areaLights.size()];
-    Colr color = light->materials[0].emissColor;
-    Vec3f lightDirection = (randomPointOnTriangle(light) - intersectionPoint());
+/* Direct light from the area lights at the current hit, for a diffuse surface. One sample
+   of a light picked by power and a point on it picked by area, and one cosine-weighted BSDF
+   sample, combined with the power heuristic like environmentLight(). The photon map keeps
+   no photons from the lights' first hits, so this does not double count. */
+Colr Ray::directLight(const MaterialIO &material) const {
+    Colr result = Colr(0,0,0);
+    Vec3f directions[2];
+    float distances[2];
+    Mesh *lights[2];
+    Colr contributions[2];
+    int count = directLightSamples(material, directions, distances, lights, contributions);
+    for (int i = 0; i < count; i++) {
+        if (lights[i] != NULL) {
+            result += contributions[i] * areaShadow(directions[i], distances[i], lights[i]);
+        } else {
+            result += contributions[i] * emittedLight(directions[i]);
+        }
+    }
+    return result;
+}
 
-    float lightDistance = lightDirection.length();
-    lightDirection = lightDirection.normalize();
-    float attenuationFactor = attenuationFactorAreaLight(lightDistance);
+/* directLight()'s samples before their shadow rays. A light sample has the light and the
+   distance to the point on it, to test with areaShadow(); the BSDF sample has no light,
+   and adds its contribution times what emittedLight() finds in its direction. */
+int Ray::directLightSamples(const MaterialIO &material, Vec3f directions[2], float distances[2], Mesh *lights[2], Colr contributions[2]) const {
+    int count = 0;
+    Colr albedo = Colr(material.diffColor) * (1.0 - material.ktran);
+
+    // Light sample, its pdf turned from per area into per solid angle.
+    float lightPdf;
+    Mesh *light = sampleLight(lightPdf);
+    Vec3f lightNormal;
+    Vec3f toLight = light->samplePoint(randf(), randf(), lightNormal) - intersectionPoint();
+    float distance = toLight.length();
+    Vec3f wi = Vec3f::normalize(toLight);
+    float cosTheta = Vec3f::dot(wi, intersectionNormal);
+    // Lights emit on the side their normals point away from, as buildPhotonMap() has it.
+    float cosLight = Vec3f::dot(wi, lightNormal);
+    if (distance > 0 && cosTheta > 0 && cosLight > 0) {
+        float pdf = lightPdf / light->area * distance * distance / cosLight;
+        float bsdfPdf = cosTheta * M_1_PI;
+        float weight = powerHeuristic(pdf, bsdfPdf);
+        directions[count] = wi;
+        distances[count] = distance;
+        lights[count] = light;
+        contributions[count++] = albedo * Colr(materialTable[light->firstMaterial].emissColor) * (M_1_PI * cosTheta * weight / pdf);
+    }
 
+    // BSDF sample. f * cos / pdf is just the albedo for a cosine-sampled Lambertian.
+    wi = cosineSampleHemisphere(intersectionNormal);
+    if (Vec3f::dot(wi, intersectionNormal) > 0) {
+        directions[count] = wi;
+        distances[count] = INFINITY;
+        lights[count] = NULL;
+        contributions[count++] = albedo;
+    }
+    return count;
+}
 
-    Vec3f shadowFactor = areaShadow(lightDirection, lightDistance, light);
-    Vec3f directLight = diffuse(lightDirection, color) * shadowFactor * attenuationFactor;
-    return directLight;
+/* The emission of the area light the current hit sees first in direction L, weighted for
+   a BSDF sample against directLight()'s light sample. Black if that is not an area light. */
+Colr Ray::emittedLight(const Vec3f &L) const {
+    RAY_STAT(rays[SHADOW_RAY]);
+    Ray lightRay = Ray(intersectionPoint() + intersectionNormal*BUMP_EPSILON, L);
+    for (Primitive *object: objects) {
+        object->intersect(lightRay);
+    }
+    if (lightRay.t_max == INFINITY) {
+        return Colr(0,0,0);
+    }
+    for (size_t i = 0; i < areaLights.size(); i++) {
+        if (lightRay.currentObject != areaLights[i]) { continue; }
+        float cosLight = Vec3f::dot(L, areaLights[i]->normals[lightRay.primitiveIndex]);
+        if (cosLight <= 0) { break; }
+        float lightPdf = lightDistribution.pdf(i) / areaLights[i]->area * lightRay.t_max * lightRay.t_max / cosLight;
+        float bsdfPdf = Vec3f::dot(L, intersectionNormal) * M_1_PI;
+        return Colr(materialTable[areaLights[i]->firstMaterial].emissColor) * powerHeuristic(bsdfPdf, lightPdf);
+    }
+    return Colr(0,0,0);
 }
 
 Colr Ray::areaShadow(const Vec3f &L, const float lightDistance, Mesh* light) const {
+    RAY_STAT(rays[SHADOW_RAY]);
     Colr shadowFactor = Colr(1,1,1);
     for( auto object : objects){
         Ray shadowRay = Ray(intersectionPoint() + intersectionNormal*BUMP_EPSILON , L);
@@ -261,8 +452,9 @@ Colr Ray::areaShadow(const Vec3f &L, const float lightDistance, Mesh* light) con
             if(shadowRay.currentObject == light){ continue; }
             Vec3f intersectVector = shadowRay.intersectionPoint() - shadowRay.startPosition;
             if( (intersectVector.length() >= lightDistance) ){ continue; }
-            if(shadowRay.material.ktran < 0.001f){return Colr(0,0,0);}
-            shadowFactor = shadowFactor * (Colr(shadowRay.material.diffColor).normalizeColor()) * shadowRay.material.ktran;
+            MaterialIO blocker = shadowRay.shadingMaterial();
+            if(blocker.ktran < 0.001f){return Colr(0,0,0);}
+            shadowFactor = shadowFactor * (Colr(blocker.diffColor).normalizeColor()) * blocker.ktran;
         }
     }
     return shadowFactor;
@@ -270,21 +462,23 @@ Colr Ray::areaShadow(const Vec3f &L, const float lightDistance, Mesh* light) con
 
 
 Colr Ray::shadow(const Vec3f &L, const float lightDistance) const {
+    RAY_STAT(rays[SHADOW_RAY]);
     Colr shadowFactor = Colr(1,1,1);
     for( auto object : objects){
         Ray shadowRay = Ray(intersectionPoint() + intersectionNormal*BUMP_EPSILON , L);
         if(object->intersect(shadowRay)){
-            if(shadowRay.material.emissColor[0] > 0){ continue; }
+            MaterialIO blocker = shadowRay.shadingMaterial();
+            if(blocker.emissColor[0] > 0){ continue; }
             Vec3f intersectVector = shadowRay.intersectionPoint() - shadowRay.startPosition;
             if( (intersectVector.length() >= lightDistance) ){ continue; }
-            if(shadowRay.material.ktran < 0.001f){return Colr(0,0,0);}
-            shadowFactor = shadowFactor * (Colr(shadowRay.material.diffColor).normalizeColor()) * shadowRay.material.ktran;
+            if(blocker.ktran < 0.001f){return Colr(0,0,0);}
+            shadowFactor = shadowFactor * (Colr(blocker.diffColor).normalizeColor()) * blocker.ktran;
         }
     }
     return shadowFactor;
 }
 
-Colr Ray::diffuse(const Vec3f &L, const Colr &lightColor) const {
+Colr Ray::diffuse(const MaterialIO &material, const Vec3f &L, const Colr &lightColor) const {
     Colr result = Colr(material.diffColor) * fabs(Vec3f::dot(L, intersectionNormal)) * lightColor;
     return result * (1.0-material.ktran);
 }
@@ -302,7 +496,10 @@ Colr Ray::traceeee(int bounces, std::unordered_set<Primitive*> insideObjects){
     }
 
     // We hit something, and have aquired it's material. Run surface shader
-    defaultShader(*this);
+    MaterialIO material = shadingMaterial();
+    if(currentObject->shader != NULL){
+        currentObject->shader(*this, material);
+    }
 
     // Keep track of which objects we have crossed into, for refraction rays etc..
     // Are we currently inside an object?
@@ -317,7 +514,7 @@ Colr Ray::traceeee(int bounces, std::unordered_set<Primitive*> insideObjects){
 
     /* Figure out the color to return: */
 
-    Colr ambientColor = ambient();
+    Colr ambientColor = ambient(material);
 
     /* Per light stuff: diffuse, specular, shadow: */
     Colr diffuseColor, specularColor;
@@ -340,17 +537,17 @@ Colr Ray::traceeee(int bounces, std::unordered_set<Primitive*> insideObjects){
         }
         attenuation = attenuationFactor(intersectionPoint(), light);
         Vec3f shadowFactor = shadow(lightDirection, lightDistance);
-        diffuseColor += diffuse(lightDirection, color) * shadowFactor * attenuation;
-        specularColor += specular(lightDirection, color) * shadowFactor * attenuation;
+        diffuseColor += diffuse(material, lightDirection, color) * shadowFactor * attenuation;
+        specularColor += specular(material, lightDirection, color) * shadowFactor * attenuation;
     }
 
     Colr reflectionColor = Colr(0,0,0);
-    if(isReflective()) {
+    if(isReflective(material)) {
         reflectionColor = reflection(intersectionPoint(), bounces-1, insideObjects);
     }
 
     Colr refractionColor = Colr(0,0,0);
-    if(isTransparent()){
+    if(isTransparent(material)){
         // If we are entering a new object, add it to the set.
         std::unordered_set<Primitive*> mySet(insideObjects);
         if(enteringCurrentObject){
@@ -369,13 +566,13 @@ Colr Ray::traceeee(int bounces, std::unordered_set<Primitive*> insideObjects){
     return result;
 }
 
-bool Ray::isReflective() const {
+bool Ray::isReflective(const MaterialIO &material) const {
     return (material.specColor[0] > 0.0
             || material.specColor[1] > 0.0
             || material.specColor[2] > 0.0) && t_max < INFINITY;
 }
 
-bool Ray::isTransparent() const {
+bool Ray::isTransparent(const MaterialIO &material) const {
     return material.ktran >= 0.001 && t_max < INFINITY;
 }
 
@@ -387,12 +584,13 @@ Ray Ray::reflectionRay(const Pos point) const {
 
 }
 
-Colr Ray::reflection(const Pos point, const int bounces, const std::unordered_set<Primitive*> mySet) const {
+Colr Ray::reflection(const Pos point, const int bounces, const std::unordered_set<Primitive*> mySet, const int depth, const float importance) const {
+    RAY_STAT(rays[REFLECTION_RAY]);
     Vec3f incident = Vec3f::normalize(direction);
     double cosI = -Vec3f::dot(intersectionNormal, incident);
     Vec3f reflectedDirection =  incident + intersectionNormal * cosI * 2;
     Ray reflectionRay = Ray(point + intersectionNormal*BUMP_EPSILON, reflectedDirection);
-    Colr reflectionColor = reflectionRay.pathTrace(bounces, mySet);
+    Colr reflectionColor = reflectionRay.pathTrace(bounces, mySet, depth, importance);
     return reflectionColor;
 }
 
@@ -416,7 +614,9 @@ Ray Ray::refractionRay(const Pos point, const float ior_a, const float ior_b) co
 
 }
 
-Colr Ray::refraction(const Pos point, const int bounces, const float ior_a, const float ior_b, const std::unordered_set<Primitive*> mySet, const std::unordered_set<Primitive*> oldSet){
+Colr Ray::refraction(const Pos point, const int bounces, const float ior_a, const float ior_b, const std::unordered_set<Primitive*> mySet, const std::unordered_set<Primitive*> oldSet,
+                     const int depth, const float importance){
+    RAY_STAT(rays[REFRACTION_RAY]);
     Vec3f incident = direction * -1.0;
     float n = ior_b / ior_a;
     float cosThetaI = Vec3f::dot(incident, intersectionNormal);
@@ -428,15 +628,15 @@ Colr Ray::refraction(const Pos point, const int bounces, const float ior_a, cons
     Vec3f newDirection = incident * -(1.0/n) - intersectionNormal * (cosThetaT - (1.0/n) * cosThetaI);
 
     if (thetaI >= asin(ior_b/ior_a)) {
-        return Ray(intersectionPoint()+intersectionNormal*BUMP_EPSILON, newDirection).pathTrace(bounces-1, oldSet);
+        return Ray(intersectionPoint()+intersectionNormal*BUMP_EPSILON, newDirection).pathTrace(bounces-1, oldSet, depth, importance);
     }
     else{
-        return Ray(intersectionPoint() - intersectionNormal * BUMP_EPSILON, newDirection).pathTrace(bounces-1, mySet);
+        return Ray(intersectionPoint() - intersectionNormal * BUMP_EPSILON, newDirection).pathTrace(bounces-1, mySet, depth, importance);
     }
 }
 
 
-Colr Ray::specular(const Vec3f &L, Colr &color) const {
+Colr Ray::specular(const MaterialIO &material, const Vec3f &L, Colr &color) const {
     float q = material.shininess * 30.0;
     Colr Ks = Colr(material.specColor);
     Vec3f V = direction*(-1.0); // Incident flipped - ray from point to eye. Normalized.
@@ -459,7 +659,7 @@ float Ray::attenuationFactor(const Pos point, const LightIO* light) const {
     return fmin(1.0, 1.0 / (c1 + c2*d + c3*d*d));
 }
 
-Colr Ray::ambient() const {
+Colr Ray::ambient(const MaterialIO &material) const {
     return Colr(material.diffColor[0] * material.ambColor[0],
                 material.diffColor[1] * material.ambColor[1],
                 material.diffColor[2] * material.ambColor[2]) * (1.0-material.ktran);
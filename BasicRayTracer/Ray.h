@@ -3,17 +3,30 @@
 #define __RAY_H
 #include <vector>
 #include <math.h>
+#include <stdint.h>
 #include <unordered_set>
 #include "Vec3f.h"
 #include "scene_io.h"
 
 class Primitive;
 class Ray;
-typedef void(*surface_shader)(Ray &ray);
+typedef void(*surface_shader)(const Ray &ray, MaterialIO &material);
 #define BACKGROUND_COLOR Colr(0,0,0)
 #define BUMP_EPSILON 0.0001
 #define IOR_AIR 1.0
 #define IOR_GLASS 1.4  
+#define PHOTON_MAX_BOUNCES 10
+
+// Russian roulette: after the minimum depth a path or photon goes on with a probability
+// that follows what it still carries, clamped to the survival range, and survivors are
+// scaled up by its inverse, so the image doesn't change on average. Every survivor of a
+// low survival is that much brighter, and one bright sample darkens a tone mapped image.
+#define PATH_RR_MIN_DEPTH 2
+#define PATH_RR_MIN_SURVIVAL 0.25f
+#define PATH_RR_MAX_SURVIVAL 0.95f
+#define PHOTON_RR_MIN_DEPTH 0
+#define PHOTON_RR_MIN_SURVIVAL 0.05f
+#define PHOTON_RR_MAX_SURVIVAL 0.95f
 
 class Mesh;
 class PhotonMap;
@@ -21,10 +34,10 @@ class Ray
 {
 
 private:
-    bool isReflective() const;
-    bool isTransparent() const;
+    bool isReflective(const MaterialIO &material) const;
+    bool isTransparent(const MaterialIO &material) const;
 public:
-	static size_t counter;
+	static thread_local size_t counter;     // Per render thread
 	size_t _id;
 
     Pos startPosition;
@@ -37,21 +50,23 @@ public:
     float t_max;
     float u;
     float v;
-    MaterialIO material;
+    uint32_t materialId;        // Of the closest hit, in the scene's MaterialTable
+    uint32_t primitiveIndex;    // Triangle of currentObject that was hit
     Vec3f intersectionNormal;
 
     Primitive* currentObject;
-    surface_shader surfaceShader;
     Pos intersectionPoint() const;
+    MaterialIO shadingMaterial() const;
     Colr traceeee(int bounces, std::unordered_set<Primitive*> insideObjects);
-    Colr pathTrace(int bounces, std::unordered_set<Primitive*> insideObjects);
+    Colr pathTrace(int bounces, std::unordered_set<Primitive*> insideObjects, const int depth = 0, const float importance = 1);
     Colr trace(int bounces);
-    Colr diffuse(const Vec3f &L, const Colr &color) const;
-    Colr specular(const Vec3f &L, Colr &color) const;
-    Colr ambient() const;
+    Colr diffuse(const MaterialIO &material, const Vec3f &L, const Colr &color) const;
+    Colr specular(const MaterialIO &material, const Vec3f &L, Colr &color) const;
+    Colr ambient(const MaterialIO &material) const;
 
-    Colr reflection(const Pos point, const int bounces, std::unordered_set<Primitive*> mySet) const;
-    Colr refraction(const Pos point, const int bounces, const float ior_a, const float ior_b, std::unordered_set<Primitive*> mySet, std::unordered_set<Primitive*> oldSet);
+    Colr reflection(const Pos point, const int bounces, std::unordered_set<Primitive*> mySet, const int depth = 0, const float importance = 1) const;
+    Colr refraction(const Pos point, const int bounces, const float ior_a, const float ior_b, std::unordered_set<Primitive*> mySet, std::unordered_set<Primitive*> oldSet,
+                    const int depth = 0, const float importance = 1);
     Ray reflectionRay(const Pos point) const;
     Ray refractionRay(const Pos point, const float ior_a, const float ior_b) const;
     Colr shadow(const Vec3f &L, const float lightDistance) const;
@@ -64,10 +79,23 @@ public:
 
     static Vec3f uniformSampleHemisphere(const Vec3f normal);
     static Vec3f cosineSampleHemisphere(const Vec3f &direction);
-    Colr indirectLight(const Vec3f direction, const int bounces, const std::unordered_set<Primitive*> insideObjects);
-    Colr directLight();
+    Colr indirectLight(const MaterialIO &material, const Vec3f direction, const int bounces, const std::unordered_set<Primitive*> insideObjects);
+    Colr directLight(const MaterialIO &material) const;
+    int directLightSamples(const MaterialIO &material, Vec3f directions[2], float distances[2], Mesh *lights[2], Colr contributions[2]) const;
+    Colr emittedLight(const Vec3f &L) const;
+    Colr environmentLight(const MaterialIO &material) const;
+    int environmentSamples(const MaterialIO &material, Vec3f directions[2], Colr contributions[2]) const;
+    Colr background() const;
 
 
 };
 
+// Whether a path at `depth` with `importance` left goes on, and the probability `survival` it had.
+bool russianRoulette(const int depth, const int minDepth, const float importance, const float minSurvival, const float maxSurvival, float &survival);
+// The share of light a material passes on by specular reflection, and by transmission.
+float specularImportance(const MaterialIO &material);
+float transmissionImportance(const MaterialIO &material);
+// Radiance at `point` estimated from the `numPoints` nearest photons of the global photon map.
+Colr computeRadiance(const Pos &point, const Vec3f &normal, const int numPoints);
+
 #endif
\ No newline at end of file
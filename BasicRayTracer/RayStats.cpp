@@ -0,0 +1,102 @@
+//
+//  RayStats.cpp
+//  BasicRayTracer
+//
+
+#include "RayStats.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+std::mutex registryMutex;
+std::vector<RayStats*> liveThreads;
+RayStats exitedThreads;     // Counts of threads that have finished
+
+/* A thread's counters, listed in the registry for as long as the thread runs. */
+struct ThreadStats {
+    RayStats stats;
+    ThreadStats(){
+        std::lock_guard<std::mutex> lock(registryMutex);
+        liveThreads.push_back(&stats);
+    }
+    ~ThreadStats(){
+        std::lock_guard<std::mutex> lock(registryMutex);
+        exitedThreads.add(stats);
+        liveThreads.erase(std::find(liveThreads.begin(), liveThreads.end(), &stats));
+    }
+};
+
+thread_local ThreadStats threadStats;
+
+double ratio(const uint64_t a, const uint64_t b){
+    return b > 0 ? (double)a / b : 0;
+}
+
+}
+
+RayStats::RayStats(){
+    memset(this, 0, sizeof(RayStats));
+}
+
+void RayStats::add(const RayStats &other){
+    nodesVisited += other.nodesVisited;
+    leavesVisited += other.leavesVisited;
+    trianglesTested += other.trianglesTested;
+    trianglesHit += other.trianglesHit;
+    photonQueries += other.photonQueries;
+    photonsVisited += other.photonsVisited;
+    for (int i = 0; i < RAY_TYPE_COUNT; i++) {
+        rays[i] += other.rays[i];
+    }
+}
+
+uint64_t RayStats::totalRays() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < RAY_TYPE_COUNT; i++) {
+        sum += rays[i];
+    }
+    return sum;
+}
+
+RayStats& RayStats::local(){
+    return threadStats.stats;
+}
+
+RayStats RayStats::total(){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    RayStats sum = exitedThreads;
+    for (RayStats *stats: liveThreads) {
+        sum.add(*stats);
+    }
+    return sum;
+}
+
+void RayStats::reset(){
+    std::lock_guard<std::mutex> lock(registryMutex);
+    exitedThreads = RayStats();
+    for (RayStats *stats: liveThreads) {
+        *stats = RayStats();
+    }
+}
+
+void RayStats::print() const {
+    static const char *names[RAY_TYPE_COUNT] = { "camera", "shadow", "reflection", "refraction", "indirect", "photon" };
+    uint64_t raysTraced = totalRays();
+    printf("Rays by type          count      share\n");
+    for (int i = 0; i < RAY_TYPE_COUNT; i++) {
+        printf("  %-12s %14llu %9.1f%%\n", names[i], (unsigned long long)rays[i], 100 * ratio(rays[i], raysTraced));
+    }
+    printf("  %-12s %14llu\n", "total", (unsigned long long)raysTraced);
+    printf("Traversal             total    per ray\n");
+    printf("  %-12s %14llu %10.2f\n", "nodes", (unsigned long long)nodesVisited, ratio(nodesVisited, raysTraced));
+    printf("  %-12s %14llu %10.2f\n", "leaves", (unsigned long long)leavesVisited, ratio(leavesVisited, raysTraced));
+    printf("  %-12s %14llu %10.2f\n", "tri tests", (unsigned long long)trianglesTested, ratio(trianglesTested, raysTraced));
+    printf("  %-12s %14llu %10.2f  (%.1f%% of tests)\n", "tri hits", (unsigned long long)trianglesHit, ratio(trianglesHit, raysTraced), 100 * ratio(trianglesHit, trianglesTested));
+    printf("Photon map            total  per query\n");
+    printf("  %-12s %14llu\n", "queries", (unsigned long long)photonQueries);
+    printf("  %-12s %14llu %10.2f\n", "visited", (unsigned long long)photonsVisited, ratio(photonsVisited, photonQueries));
+}
@@ -0,0 +1,59 @@
+//
+//  RayStats.h
+//  BasicRayTracer
+//
+//  Optional counters for finding out why a scene is slow: kd-tree nodes and
+//  leaves visited, triangles tested and hit, photons visited by the photon map's
+//  kNN queries, and rays traced by type. Each thread counts into its own
+//  RayStats, so the counters need no locking; RayStats::total() adds them up
+//  once rendering is done. With RAY_STATS defined, renders also save a per-pixel
+//  cost heatmap next to the image, see Framebuffer::saveCostMap().
+//
+//  Without RAY_STATS, RAY_STAT() compiles to nothing.
+//
+
+#ifndef __BasicRayTracer__RayStats__
+#define __BasicRayTracer__RayStats__
+
+#include <stdint.h>
+
+//#define RAY_STATS
+
+#ifdef RAY_STATS
+#define RAY_STAT(counter) (RayStats::local().counter++)
+#else
+#define RAY_STAT(counter) ((void)0)
+#endif
+
+typedef enum {
+    CAMERA_RAY,
+    SHADOW_RAY,
+    REFLECTION_RAY,
+    REFRACTION_RAY,
+    INDIRECT_RAY,
+    PHOTON_RAY,
+    RAY_TYPE_COUNT
+} RayType;
+
+struct RayStats {
+    uint64_t nodesVisited;      // Node::traverse calls, inner nodes and leaves
+    uint64_t leavesVisited;
+    uint64_t trianglesTested;
+    uint64_t trianglesHit;      // Tests that found a closer hit
+    uint64_t photonQueries;
+    uint64_t photonsVisited;    // Photon kd-tree nodes looked at by the queries
+    uint64_t rays[RAY_TYPE_COUNT];
+
+    RayStats();
+    void add(const RayStats &other);
+    uint64_t totalRays() const;
+    void print() const;
+
+    // The calling thread's counters.
+    static RayStats& local();
+    // Every thread's counters added up. Only exact while no thread is counting.
+    static RayStats total();
+    static void reset();
+};
+
+#endif /* defined(__BasicRayTracer__RayStats__) */
@@ -0,0 +1,224 @@
+//
+//  Regression.cpp
+//  BasicRayTracer
+//
+
+#include "Regression.h"
+#include <stdio.h>
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include "EasyBMP.h"
+
+#ifdef WIN32   // Windows system specific
+#include <windows.h>
+#include <psapi.h>
+#include <direct.h>
+#pragma comment(lib, "psapi.lib")
+#else          // Unix based system specific
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+const char *const Regression::scenes[] = {
+    "../Scenes/test1.ascii",
+    "../Scenes/test2.ascii",
+    "../Scenes/test3.ascii",
+    "../Scenes/test4.ascii",
+    "../Scenes/test5.ascii",
+    "../Scenes2/test1.ascii",
+    "../Scenes2/test2.ascii",
+    "../Scenes2/test3.ascii",
+    "../Scenes2/test4.ascii",
+    "../Scenes2/test5.ascii",
+    "../Scenes2/cornell_pointlight.ascii",
+    "../Scenes2/cornell_arealight.ascii",
+};
+const int Regression::sceneCount = sizeof(scenes) / sizeof(scenes[0]);
+
+namespace {
+
+// "../Scenes2/test1.ascii" -> "Scenes2_test1"
+std::string baseName(const std::string &scene){
+    std::string name = scene;
+    while (name.compare(0, 3, "../") == 0) {
+        name = name.substr(3);
+    }
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && name.find('/', dot) == std::string::npos) {
+        name = name.substr(0, dot);
+    }
+    for (char &c: name) {
+        if (c == '/' || c == '\\') {
+            c = '_';
+        }
+    }
+    return name;
+}
+
+const RegressionResult* find(const std::vector<RegressionResult> &results, const std::string &scene){
+    for (const RegressionResult &result: results) {
+        if (result.scene == scene) {
+            return &result;
+        }
+    }
+    return NULL;
+}
+
+// Adds `what` to `failures` when `value` grew too much over `base`.
+void compare(const char *what, const double value, const double base, const double slack, std::string &failures){
+    if (value > base * (1 + REGRESSION_TIME_TOLERANCE) && value - base > slack) {
+        char text[96];
+        snprintf(text, sizeof(text), " %s +%.0f%%", what, base > 0 ? (value / base - 1) * 100 : INFINITY);
+        failures += text;
+    }
+}
+
+}
+
+bool Regression::prepare(const char *directory){
+#ifdef WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+    FILE *probe = fopen(resultsFile(directory, false).c_str(), "a");
+    if (probe == NULL) {
+        printf("Can't write to regression directory '%s'.\n", directory);
+        return false;
+    }
+    fclose(probe);
+    return true;
+}
+
+std::string Regression::imageFile(const char *directory, const std::string &scene, const bool baseline){
+    return std::string(directory) + "/" + baseName(scene) + (baseline ? ".bmp" : "_latest.bmp");
+}
+
+std::string Regression::resultsFile(const char *directory, const bool baseline){
+    return std::string(directory) + (baseline ? "/baseline.txt" : "/latest.txt");
+}
+
+std::string Regression::sceneResultsFile(const char *directory, const std::string &scene){
+    return std::string(directory) + "/" + baseName(scene) + "_latest.txt";
+}
+
+long Regression::peakKB(){
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // Bytes on OS X
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+bool Regression::write(const std::string &filename, const std::vector<RegressionResult> &results){
+    FILE *file = fopen(filename.c_str(), "w");
+    if (file == NULL) {
+        printf("Can't open file '%s' for writing.\n", filename.c_str());
+        return false;
+    }
+    fprintf(file, "# %dx%d, %d samples per pixel, seed %d. Times in seconds, peak resident memory in KB.\n",
+            REGRESSION_WIDTH, REGRESSION_HEIGHT, REGRESSION_SAMPLES, REGRESSION_SEED);
+    fprintf(file, "# scene load build photon render rays/s peak\n");
+    for (const RegressionResult &r: results) {
+        fprintf(file, "%s %.4f %.4f %.4f %.4f %.0f %ld\n", r.scene.c_str(), r.loadSeconds, r.buildSeconds,
+                r.photonSeconds, r.renderSeconds, r.raysPerSecond, r.peakKB);
+    }
+    fclose(file);
+    return true;
+}
+
+bool Regression::read(const std::string &filename, std::vector<RegressionResult> &results){
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        printf("Can't open regression baseline '%s'. Run --regress-update first.\n", filename.c_str());
+        return false;
+    }
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        RegressionResult r;
+        if (!(stream >> r.scene)) {
+            continue;
+        }
+        if (!(stream >> r.loadSeconds >> r.buildSeconds >> r.photonSeconds >> r.renderSeconds >> r.raysPerSecond >> r.peakKB)) {
+            printf("Error in regression baseline '%s' at line %d.\n", filename.c_str(), lineNumber);
+            return false;
+        }
+        results.push_back(r);
+    }
+    return true;
+}
+
+bool Regression::imageError(const std::string &baselineFile, const std::string &imageFile, double &rmse, double &psnr){
+    BMP baseline, image;
+    if (!baseline.ReadFromFile(baselineFile.c_str()) || !image.ReadFromFile(imageFile.c_str())) {
+        return false;
+    }
+    if (baseline.TellWidth() != image.TellWidth() || baseline.TellHeight() != image.TellHeight()) {
+        printf("%s and %s differ in size.\n", baselineFile.c_str(), imageFile.c_str());
+        return false;
+    }
+    double sum = 0;
+    for (int j = 0; j < image.TellHeight(); j++) {
+        for (int i = 0; i < image.TellWidth(); i++) {
+            const RGBApixel *a = baseline(i, j), *b = image(i, j);
+            double dr = a->Red - b->Red, dg = a->Green - b->Green, db = a->Blue - b->Blue;
+            sum += dr * dr + dg * dg + db * db;
+        }
+    }
+    rmse = sqrt(sum / (3.0 * image.TellWidth() * image.TellHeight()));
+    psnr = rmse > 0 ? 20 * log10(255 / rmse) : INFINITY;
+    return true;
+}
+
+bool Regression::check(const char *directory, const std::vector<RegressionResult> &results){
+    std::vector<RegressionResult> baseline;
+    if (!read(resultsFile(directory, true), baseline)) {
+        return false;
+    }
+    int failed = 0;
+    for (const RegressionResult &r: results) {
+        const RegressionResult *base = find(baseline, r.scene);
+        if (base == NULL) {
+            printf("%-40s no baseline\n", r.scene.c_str());
+            failed++;
+            continue;
+        }
+        std::string failures;
+        compare("load", r.loadSeconds, base->loadSeconds, REGRESSION_TIME_SLACK, failures);
+        compare("build", r.buildSeconds, base->buildSeconds, REGRESSION_TIME_SLACK, failures);
+        compare("photon", r.photonSeconds, base->photonSeconds, REGRESSION_TIME_SLACK, failures);
+        compare("render", r.renderSeconds, base->renderSeconds, REGRESSION_TIME_SLACK, failures);
+        compare("peak memory", r.peakKB, base->peakKB, 0, failures);
+
+        double rmse = INFINITY, psnr = 0;
+        if (!imageError(imageFile(directory, r.scene, true), imageFile(directory, r.scene, false), rmse, psnr)) {
+            failures += " image missing";
+        } else if (rmse > REGRESSION_RMSE_TOLERANCE) {
+            failures += " image";
+        }
+
+        printf("%-40s load %.3fs build %.3fs photon %.3fs render %.3fs (was %.3fs), %.2fM rays/s, peak %ld KB, RMSE %.3f, PSNR %.1f dB: %s\n",
+               r.scene.c_str(), r.loadSeconds, r.buildSeconds, r.photonSeconds, r.renderSeconds, base->renderSeconds,
+               r.raysPerSecond / 1e6, r.peakKB, rmse, psnr, failures.empty() ? "ok" : ("REGRESSED:" + failures).c_str());
+        if (!failures.empty()) {
+            failed++;
+        }
+    }
+    printf("%d of %d scenes regressed.\n", failed, (int)results.size());
+    return failed == 0;
+}
@@ -0,0 +1,79 @@
+//
+//  Regression.h
+//  BasicRayTracer
+//
+//  End-to-end checks over the reference scenes. `--regress` renders every scene
+//  in Regression::scenes at REGRESSION_WIDTH * REGRESSION_HEIGHT with a fixed
+//  sample seed, so a render repeats exactly, on one thread, and records per scene:
+//
+//      load     the whole scene load, parsing and building
+//      build    the part of it spent converting meshes and building kd-trees
+//      photon   the photon map
+//      render   the trace
+//      rays/s   rays traced per second of render
+//      peak     the scene's peak resident memory, in KB
+//
+//  The numbers go to <directory>/latest.txt and the images to <scene>_latest.bmp.
+//  Both are compared with the baseline.txt and <scene>.bmp that `--regress-update`
+//  writes; a scene fails when a time or the peak memory grows by more than
+//  REGRESSION_TIME_TOLERANCE, or its image's RMSE against the baseline exceeds
+//  REGRESSION_RMSE_TOLERANCE. Changes shorter than REGRESSION_TIME_SLACK are
+//  timing noise and never fail.
+//
+//  Each scene runs in a process of its own (`--regress-scene`), so its peak
+//  memory is its own and not a high-water mark left by the scenes before it.
+//  The kd-tree cache is bypassed, as in Benchmark, so builds are always timed.
+//
+
+#ifndef __BasicRayTracer__Regression__
+#define __BasicRayTracer__Regression__
+
+#include <string>
+#include <vector>
+
+#define REGRESSION_DIRECTORY "../Regression"
+#define REGRESSION_WIDTH 128
+#define REGRESSION_HEIGHT 128
+#define REGRESSION_SAMPLES 1
+#define REGRESSION_SEED 12345
+#define REGRESSION_TIME_TOLERANCE 0.25      // Fraction a time or the peak memory may grow by
+#define REGRESSION_TIME_SLACK 0.05          // Seconds
+#define REGRESSION_RMSE_TOLERANCE 1.0       // In 8-bit levels
+
+struct RegressionResult {
+    std::string scene;
+    double loadSeconds;
+    double buildSeconds;
+    double photonSeconds;
+    double renderSeconds;
+    double raysPerSecond;
+    long peakKB;
+
+    RegressionResult(const std::string &scene = ""):scene(scene), loadSeconds(0), buildSeconds(0), photonSeconds(0),
+    renderSeconds(0), raysPerSecond(0), peakKB(0){};
+};
+
+class Regression {
+public:
+    static const char *const scenes[];
+    static const int sceneCount;
+
+    // Creates `directory` if it doesn't exist yet.
+    static bool prepare(const char *directory);
+    // Where a scene's render goes: the baseline image, or the latest one to check against it.
+    static std::string imageFile(const char *directory, const std::string &scene, const bool baseline);
+    static std::string resultsFile(const char *directory, const bool baseline);
+    // Where a scene's own process leaves its numbers for the run that started it.
+    static std::string sceneResultsFile(const char *directory, const std::string &scene);
+    // This process's peak resident set size, in KB.
+    static long peakKB();
+
+    static bool write(const std::string &filename, const std::vector<RegressionResult> &results);
+    static bool read(const std::string &filename, std::vector<RegressionResult> &results);
+    // Root mean square error over the 8-bit channels, and the PSNR in dB it makes.
+    static bool imageError(const std::string &baselineFile, const std::string &imageFile, double &rmse, double &psnr);
+    // Prints every result against the baseline in `directory`; false if any scene regressed.
+    static bool check(const char *directory, const std::vector<RegressionResult> &results);
+};
+
+#endif /* defined(__BasicRayTracer__Regression__) */
@@ -0,0 +1,155 @@
+//
+//  RenderJob.cpp
+//  BasicRayTracer
+//
+
+#include "RenderJob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+RenderJob::RenderJob(const std::string &scene, const std::string &output, const int width, const int height, const int samples):scene(scene), output(output), width(width), height(height), samples(samples), adaptiveThreshold(0), hasCamera(false){
+    memset(&camera, 0, sizeof(camera));
+}
+
+CameraIO RenderJob::cameraFor(const SceneIO *loaded) const {
+    if (!hasCamera) {
+        return *loaded->camera;
+    }
+    CameraIO result = camera;
+    result.focalDistance = loaded->camera->focalDistance;
+    return result;
+}
+
+static bool parseInt(const std::string &word, int &out){
+    char *end;
+    long value = strtol(word.c_str(), &end, 10);
+    if (*end != '\0' || value <= 0) {
+        return false;
+    }
+    out = (int)value;
+    return true;
+}
+
+static bool parseFloats(const std::vector<std::string> &words, size_t first, float *out, const int count){
+    for (int i = 0; i < count; i++) {
+        if (first + i >= words.size()) {
+            return false;
+        }
+        char *end;
+        out[i] = strtof(words[first + i].c_str(), &end);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string RenderJob::frameFilename(const int frame) const {
+    char number[32];
+    if (output.find('%') != std::string::npos) {
+        std::vector<char> name(output.size() + sizeof(number));
+        snprintf(&name[0], name.size(), output.c_str(), frame);
+        return std::string(&name[0]);
+    }
+    snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = output.rfind('.');
+    if (dot == std::string::npos || output.find('/', dot) != std::string::npos) {
+        return output + number;
+    }
+    return output.substr(0, dot) + number + output.substr(dot);
+}
+
+// One integer conversion, like %d or %04d, and no other '%', so the name is safe to format.
+static bool isFramePattern(const std::string &output){
+    size_t percent = output.find('%');
+    if (percent == std::string::npos || output.find('%', percent + 1) != std::string::npos) {
+        return false;
+    }
+    size_t end = output.find_first_not_of("0123456789", percent + 1);
+    return end != std::string::npos && output[end] == 'd';
+}
+
+bool RenderJob::parse(const std::vector<std::string> &words, RenderJob &job){
+    if (words.size() < 2) {
+        return false;
+    }
+    job.scene = words[0];
+    job.output = words[1];
+    size_t i = 2;
+    int *settings[3] = { &job.width, &job.height, &job.samples };
+    for (int k = 0; k < 3 && i < words.size() && words[i] != "adaptive" && words[i] != "camera" && words[i] != "path"; k++, i++) {
+        if (!parseInt(words[i], *settings[k])) {
+            return false;
+        }
+    }
+    if (i < words.size() && words[i] == "adaptive") {
+        if (!parseFloats(words, i + 1, &job.adaptiveThreshold, 1) || job.adaptiveThreshold <= 0) {
+            return false;
+        }
+        i += 2;
+    }
+    if (i < words.size() && words[i] == "path") {
+        if (job.output.find('%') != std::string::npos && !isFramePattern(job.output)) {
+            return false;
+        }
+        return i + 2 == words.size() && job.path.load(words[i + 1].c_str());
+    }
+    if (i < words.size()) {
+        if (words[i] != "camera") {
+            return false;
+        }
+        float values[10];
+        if (!parseFloats(words, i + 1, values, 10) || i + 11 != words.size()) {
+            return false;
+        }
+        job.hasCamera = true;
+        memcpy(job.camera.position, values, sizeof(Point));
+        memcpy(job.camera.viewDirection, values + 3, sizeof(Vec));
+        memcpy(job.camera.orthoUp, values + 6, sizeof(Vec));
+        job.camera.verticalFOV = values[9];
+    }
+    return true;
+}
+
+bool RenderJob::readFile(const char *filename, const RenderJob &defaults, std::vector<RenderJob> &jobs){
+    std::ifstream file(filename);
+    if (!file) {
+        printf("Can't open job file '%s'.\n", filename);
+        return false;
+    }
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (stream >> word) {
+            words.push_back(word);
+        }
+        if (words.empty()) {
+            continue;
+        }
+        RenderJob job = defaults;
+        if (!parse(words, job)) {
+            printf("Error in job file '%s' at line %d: expected scene output [width [height [samples]]] [adaptive <threshold>] [camera <10 numbers> | path <file>].\n", filename, lineNumber);
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+void RenderJob::groupByScene(std::vector<RenderJob> &jobs){
+    std::map<std::string, size_t> firstUse;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        firstUse.insert(std::make_pair(jobs[i].scene, i));
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [&firstUse](const RenderJob &a, const RenderJob &b){
+        return firstUse[a.scene] < firstUse[b.scene];
+    });
+}
@@ -0,0 +1,62 @@
+//
+//  RenderJob.h
+//  BasicRayTracer
+//
+//  One image to render: a scene, an optional camera replacing the scene's, the
+//  resolution, samples per pixel and the output file. Or, with a camera path, a
+//  sequence of them. Jobs come from the command line or from a job file with one
+//  job per line:
+//
+//      # scene                              output      width height samples
+//      ../Scenes2/cornell_arealight.ascii   cornell.bmp 512   512    1
+//      ../Scenes2/cornell_arealight.ascii   side.hdr    256   256    4  camera 1 0 -4  -0.2 0 1  0 1 0  0.71
+//      ../Scenes2/cornell_arealight.ascii   fly%03d.bmp 256   256    1  path flythrough.path
+//      ../Scenes2/cornell_arealight.ascii   noisy.bmp   512   512    16 adaptive 0.02
+//
+//  Width, height and samples may be left off from the right. `adaptive` spends the
+//  samples per pixel as a budget, on the noisiest tiles first, and stops early once
+//  every tile's relative error is below the threshold, see Framebuffer::renderAdaptive().
+//  It comes before a camera or path. A camera is given
+//  as position, view direction, up vector and vertical field of view; the
+//  focal distance stays the scene's. A path renders every frame of a
+//  CameraPath file; the output names the frames with a printf-style number,
+//  or gets _0000, _0001, ... before its extension. Text after a '#' is ignored.
+//
+
+#ifndef __BasicRayTracer__RenderJob__
+#define __BasicRayTracer__RenderJob__
+
+#include <string>
+#include <vector>
+#include "scene_io.h"
+#include "CameraPath.h"
+
+struct RenderJob {
+    std::string scene;
+    std::string output;
+    int width;
+    int height;
+    int samples;
+    float adaptiveThreshold;    // 0 for `samples` samples in every pixel
+    bool hasCamera;
+    CameraIO camera;        // Only if hasCamera
+    CameraPath path;        // Empty for a single image
+
+    RenderJob(const std::string &scene, const std::string &output, const int width, const int height, const int samples);
+
+    // The camera to render with: the job's own, or else the loaded scene's.
+    CameraIO cameraFor(const SceneIO *loaded) const;
+    // Output file of frame `frame` of a sequence.
+    std::string frameFilename(const int frame) const;
+
+    // Parses one job from `words`: scene output [width [height [samples]]] [adaptive <threshold>] [camera <10 numbers> | path <file>].
+    // Settings the words leave out keep the values in `job`.
+    static bool parse(const std::vector<std::string> &words, RenderJob &job);
+    // Appends the jobs in `filename`, with `defaults` for what a line leaves out.
+    // Reports the first bad line and returns false.
+    static bool readFile(const char *filename, const RenderJob &defaults, std::vector<RenderJob> &jobs);
+    // Reorders jobs so the ones on the same scene follow each other, keeping their order otherwise.
+    static void groupByScene(std::vector<RenderJob> &jobs);
+};
+
+#endif /* defined(__BasicRayTracer__RenderJob__) */
@@ -0,0 +1,59 @@
+//
+//  SampleStream.cpp
+//  BasicRayTracer
+//
+
+#include "SampleStream.h"
+
+#define PIXEL_STREAMS 1
+#define PHOTON_STREAMS 2
+
+uint64_t SampleStream::seed = SAMPLE_SEED;
+
+namespace {
+
+// The splitmix64 finalizer: every input bit affects every output bit.
+uint64_t mix(uint64_t z){
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+}
+
+SampleStream& SampleStream::local(){
+    // Threads that never begin a stream still get repeatable numbers.
+    thread_local SampleStream stream = SampleStream(mix(seed));
+    return stream;
+}
+
+void SampleStream::beginPixel(const int x, const int y, const int sample){
+    SampleStream &stream = local();
+    stream.key = mix(mix(mix(seed ^ PIXEL_STREAMS) ^ (((uint64_t)(uint32_t)y << 32) | (uint32_t)x)) ^ (uint32_t)sample);
+    stream.dimension = 0;
+}
+
+void SampleStream::beginPhoton(const long photon){
+    SampleStream &stream = local();
+    stream.key = mix(mix(seed ^ PHOTON_STREAMS) ^ (uint64_t)photon);
+    stream.dimension = 0;
+}
+
+SampleStream SampleStream::current(){
+    return local();
+}
+
+void SampleStream::resume(const SampleStream &stream){
+    local() = stream;
+}
+
+SampleStream SampleStream::split(const int branch) const {
+    return SampleStream(mix(mix(key + dimension) ^ (uint32_t)branch));
+}
+
+float SampleStream::next(){
+    SampleStream &stream = local();
+    // The top 24 bits fill a float's mantissa exactly, so 1 is never returned.
+    return (mix(stream.key + stream.dimension++) >> 40) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,49 @@
+//
+//  SampleStream.h
+//  BasicRayTracer
+//
+//  Random numbers that don't depend on scheduling. Every camera sample and every
+//  photon gets its own stream, keyed on its pixel and sample index or its photon
+//  index; the n-th number drawn from a stream is a hash of the seed, that key and
+//  n (the dimension). Whichever thread takes a sample and whatever ran before
+//  it, the sample makes the same decisions, so renders are bit-identical for any
+//  thread count.
+//
+//  Each thread draws from its own current stream. Renderers begin() one before
+//  tracing a sample; randf() and Framebuffer::jitter() take the next number.
+//  The wavefront renderer, which works on many samples in turn, keeps a stream
+//  per path and resume()s it before drawing for that path.
+//
+
+#ifndef __BasicRayTracer__SampleStream__
+#define __BasicRayTracer__SampleStream__
+
+#include <stdint.h>
+
+#define SAMPLE_SEED 0
+
+class SampleStream {
+private:
+    uint64_t key;
+    uint64_t dimension;     // Numbers drawn so far
+
+    SampleStream(const uint64_t key):key(key), dimension(0){};
+    static SampleStream& local();
+public:
+    static uint64_t seed;   // Changes every stream, for an independent render of the same scene
+
+    // Starts the calling thread's stream for sample `sample` of pixel (x, y).
+    static void beginPixel(const int x, const int y, const int sample);
+    // Starts the calling thread's stream for photon `photon`.
+    static void beginPhoton(const long photon);
+    // The next number in [0, 1) from the calling thread's stream.
+    static float next();
+
+    // The calling thread's stream as it is now, to resume() later, possibly on another thread.
+    static SampleStream current();
+    static void resume(const SampleStream &stream);
+    // An independent stream for one of the paths a path branches into.
+    SampleStream split(const int branch) const;
+};
+
+#endif /* defined(__BasicRayTracer__SampleStream__) */
@@ -0,0 +1,62 @@
+//
+//  SceneBuilder.cpp
+//  BasicRayTracer
+//
+
+#include "SceneBuilder.h"
+#include <stdlib.h>
+#include <string.h>
+
+ObjIO* SceneIOBuilder::append(ObjType type, const MaterialIO *materials, long materialCount, const char *name){
+    ObjIO *obj = append_object(&scene->objects);
+    obj->type = type;
+    obj->name = NULL;
+    if (name != NULL) {
+        obj->name = (char *)malloc(strlen(name) + 1);
+        strcpy(obj->name, name);
+    }
+    obj->numMaterials = materialCount;
+    obj->material = new_material(materialCount);
+    if (materialCount > 0) {
+        memcpy(obj->material, materials, materialCount * sizeof(MaterialIO));
+    }
+    return obj;
+}
+
+void SceneIOBuilder::sphere(const SphereIO &sphere, const MaterialIO *materials, long materialCount, const char *name){
+    ObjIO *obj = append(SPHERE_OBJ, materials, materialCount, name);
+    SphereIO *data = (SphereIO *)malloc(sizeof(SphereIO));
+    *data = sphere;
+    obj->data = data;
+}
+
+void SceneIOBuilder::beginPolySet(const PolySetIO &polySet, const MaterialIO *materials, long materialCount, const char *name){
+    ObjIO *obj = append(POLYSET_OBJ, materials, materialCount, name);
+    PolySetIO *data = (PolySetIO *)malloc(sizeof(PolySetIO));
+    *data = polySet;
+    data->poly = (PolygonIO *)calloc(polySet.numPolys, sizeof(PolygonIO));
+    obj->data = data;
+    nextPolygon = data->poly;
+    endPolygon = data->poly + polySet.numPolys;
+}
+
+void SceneIOBuilder::polygon(const VertexIO *vertices, long vertexCount){
+    if (nextPolygon == endPolygon) {
+        return;
+    }
+    nextPolygon->numVertices = vertexCount;
+    nextPolygon->vert = (VertexIO *)calloc(vertexCount, sizeof(VertexIO));
+    if (vertexCount > 0) {
+        memcpy(nextPolygon->vert, vertices, vertexCount * sizeof(VertexIO));
+    }
+    nextPolygon++;
+}
+
+void SceneIOBuilder::endPolySet(){
+    nextPolygon = endPolygon = NULL;
+}
+
+/* The partial polyset stays in the scene, which the failed read deletes. */
+void SceneIOBuilder::abortPolySet(){
+    endPolySet();
+}
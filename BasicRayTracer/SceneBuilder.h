@@ -0,0 +1,51 @@
+//
+//  SceneBuilder.h
+//  BasicRayTracer
+//
+//  Receives a scene's objects while it is being read. streamScene(filename, builder)
+//  hands every sphere and polygon to the builder as soon as it is parsed, so the
+//  ObjIO -> PolySetIO -> PolygonIO -> VertexIO lists are never built; the scene
+//  it returns only holds the camera and the lights.
+//
+//  The pointers passed to a callback are only valid during that call.
+//
+
+#ifndef __BasicRayTracer__SceneBuilder__
+#define __BasicRayTracer__SceneBuilder__
+
+#include "scene_io.h"
+
+class SceneBuilder {
+public:
+    virtual ~SceneBuilder(){};
+
+    virtual void sphere(const SphereIO &sphere, const MaterialIO *materials, long materialCount, const char *name) = 0;
+
+    // `polySet` carries the header fields only (poly is NULL). Its numPolys polygons
+    // follow in file order, one polygon() call each, then endPolySet().
+    virtual void beginPolySet(const PolySetIO &polySet, const MaterialIO *materials, long materialCount, const char *name) = 0;
+    virtual void polygon(const VertexIO *vertices, long vertexCount) = 0;
+    virtual void endPolySet() = 0;
+    // Instead of endPolySet() when the file ends or breaks off partway through the polyset.
+    virtual void abortPolySet() = 0;
+};
+
+/* Builds the usual linked ObjIO lists, for code that wants a complete SceneIO. */
+class SceneIOBuilder : public SceneBuilder {
+private:
+    SceneIO *scene;
+    PolygonIO *nextPolygon;
+    PolygonIO *endPolygon;
+
+    ObjIO* append(ObjType type, const MaterialIO *materials, long materialCount, const char *name);
+public:
+    SceneIOBuilder(SceneIO *scene):scene(scene), nextPolygon(NULL), endPolygon(NULL){};
+
+    virtual void sphere(const SphereIO &sphere, const MaterialIO *materials, long materialCount, const char *name);
+    virtual void beginPolySet(const PolySetIO &polySet, const MaterialIO *materials, long materialCount, const char *name);
+    virtual void polygon(const VertexIO *vertices, long vertexCount);
+    virtual void endPolySet();
+    virtual void abortPolySet();
+};
+
+#endif /* defined(__BasicRayTracer__SceneBuilder__) */
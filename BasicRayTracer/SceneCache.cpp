@@ -0,0 +1,272 @@
+//
+//  SceneCache.cpp
+//  BasicRayTracer
+//
+
+#include "SceneCache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+
+// Mesh arrays use the position and normal tables in place.
+static_assert(sizeof(Pos) == 3 * sizeof(float) && sizeof(Vec3f) == 3 * sizeof(float), "Vec3f must be three packed floats");
+
+namespace {
+
+uint64_t align(uint64_t offset){
+    return (offset + SCENE_CACHE_ALIGNMENT - 1) & ~(uint64_t)(SCENE_CACHE_ALIGNMENT - 1);
+}
+
+template <typename T>
+uint64_t writeTable(FILE *fp, uint64_t offset, const std::vector<T> &table){
+    static const char zeros[SCENE_CACHE_ALIGNMENT] = {0};
+    uint64_t start = align(offset);
+    fwrite(zeros, 1, (size_t)(start - offset), fp);
+    if (!table.empty()) {
+        fwrite(&table[0], sizeof(T), table.size(), fp);
+    }
+    return start;
+}
+
+}
+
+bool SceneCache::isCacheFileName(const char *filename){
+    size_t length = strlen(filename);
+    size_t extension = strlen(SCENE_CACHE_EXTENSION);
+    return length > extension && strcmp(filename + length - extension, SCENE_CACHE_EXTENSION) == 0;
+}
+
+bool SceneCache::write(const SceneIO *scene, const char *filename){
+    std::vector<CameraIO> camera;
+    std::vector<SceneCacheLight> lights;
+    std::vector<MaterialIO> materials;
+    std::vector<SceneCacheObject> objects;
+    std::vector<Pos> positions;
+    std::vector<Vec3f> normals;
+    std::vector<float> texCoords;
+    std::vector<int32_t> materialIndices;
+    std::vector<uint32_t> indices;
+    std::vector<char> names;
+
+    if (scene->camera != NULL) {
+        camera.push_back(*scene->camera);
+    }
+    for (LightIO *light = scene->lights; light != NULL; light = light->next) {
+        SceneCacheLight cached;
+        cached.type = light->type;
+        memcpy(cached.position, light->position, sizeof(Point));
+        memcpy(cached.direction, light->direction, sizeof(Vec));
+        memcpy(cached.color, light->color, sizeof(Color));
+        cached.dropOffRate = light->dropOffRate;
+        cached.cutOffAngle = light->cutOffAngle;
+        lights.push_back(cached);
+    }
+
+    for (ObjIO *obj = scene->objects; obj != NULL; obj = obj->next) {
+        SceneCacheObject cached;
+        memset(&cached, 0, sizeof(cached));
+        cached.type = obj->type;
+        cached.nameOffset = -1;
+        if (obj->name != NULL) {
+            cached.nameOffset = (int32_t)names.size();
+            names.insert(names.end(), obj->name, obj->name + strlen(obj->name) + 1);
+        }
+        cached.materialFirst = (uint32_t)materials.size();
+        cached.materialCount = (uint32_t)obj->numMaterials;
+        materials.insert(materials.end(), obj->material, obj->material + obj->numMaterials);
+
+        if (obj->type == SPHERE_OBJ) {
+            cached.sphere = *(SphereIO*)obj->data;
+        } else if (obj->type == POLYSET_OBJ) {
+            PolySetIO *polySet = (PolySetIO*)obj->data;
+            cached.normType = polySet->normType;
+            cached.materialBinding = polySet->materialBinding;
+            cached.hasTextureCoords = polySet->hasTextureCoords != FALSE;
+            cached.vertexFirst = (uint32_t)positions.size();
+            cached.indexFirst = indices.size();
+
+            // Deduplicated and fan-triangulated the same way as when the mesh is loaded from the
+            // scene. Attributes the mesh doesn't use are stored as zeros.
+            Mesh mesh(polySet->normType, polySet->materialBinding, cached.hasTextureCoords, 0, obj->numMaterials, NULL);
+            for (long i = 0; i < polySet->numPolys; i++) {
+                mesh.addPolygon(polySet->poly[i].vert, polySet->poly[i].numVertices);
+            }
+            for (size_t i = 0; i < mesh.positions.size(); i++) {
+                positions.push_back(mesh.positions[i]);
+                normals.push_back(mesh.vertexNormals.empty() ? Vec3f() : mesh.vertexNormals[i]);
+                texCoords.push_back(mesh.texCoords.empty() ? 0 : mesh.texCoords[2*i]);
+                texCoords.push_back(mesh.texCoords.empty() ? 0 : mesh.texCoords[2*i + 1]);
+                materialIndices.push_back(mesh.vertexMaterials.empty() ? 0 : mesh.vertexMaterials[i]);
+            }
+            indices.insert(indices.end(), mesh.indices.data(), mesh.indices.data() + mesh.indices.size());
+            cached.vertexCount = (uint32_t)mesh.positions.size();
+            cached.triangleCount = (indices.size() - cached.indexFirst) / 3;
+        }
+        objects.push_back(cached);
+    }
+
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        std::cout << "Can't open '" << filename << "' for writing." << std::endl;
+        return false;
+    }
+
+    SceneCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, fp);
+    uint64_t offset = sizeof(header);
+    header.cameraOffset = writeTable(fp, offset, camera);
+    offset = header.cameraOffset + camera.size() * sizeof(CameraIO);
+    header.lightsOffset = writeTable(fp, offset, lights);
+    offset = header.lightsOffset + lights.size() * sizeof(SceneCacheLight);
+    header.materialsOffset = writeTable(fp, offset, materials);
+    offset = header.materialsOffset + materials.size() * sizeof(MaterialIO);
+    header.objectsOffset = writeTable(fp, offset, objects);
+    offset = header.objectsOffset + objects.size() * sizeof(SceneCacheObject);
+    header.positionsOffset = writeTable(fp, offset, positions);
+    offset = header.positionsOffset + positions.size() * sizeof(Pos);
+    header.normalsOffset = writeTable(fp, offset, normals);
+    offset = header.normalsOffset + normals.size() * sizeof(Vec3f);
+    header.texCoordsOffset = writeTable(fp, offset, texCoords);
+    offset = header.texCoordsOffset + texCoords.size() * sizeof(float);
+    header.materialIndicesOffset = writeTable(fp, offset, materialIndices);
+    offset = header.materialIndicesOffset + materialIndices.size() * sizeof(int32_t);
+    header.indicesOffset = writeTable(fp, offset, indices);
+    offset = header.indicesOffset + indices.size() * sizeof(uint32_t);
+    header.namesOffset = writeTable(fp, offset, names);
+    offset = header.namesOffset + names.size();
+
+    memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_CACHE_VERSION;
+    header.endianTag = SCENE_CACHE_ENDIAN_TAG;
+    header.headerSize = sizeof(header);
+    header.hasCamera = !camera.empty();
+    header.lightCount = (uint32_t)lights.size();
+    header.materialCount = (uint32_t)materials.size();
+    header.objectCount = (uint32_t)objects.size();
+    header.vertexCount = positions.size();
+    header.indexCount = indices.size();
+    header.namesSize = names.size();
+    header.fileSize = offset;
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    if (!ok) {
+        std::cout << "Error writing scene cache '" << filename << "'." << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << filename << ": " << objects.size() << " objects, "
+    << header.vertexCount << " vertices, " << header.indexCount / 3 << " triangles." << std::endl;
+    return true;
+}
+
+bool SceneCache::open(const char *filename){
+    close();
+    if (!file.open(filename)) {
+        std::cout << "Can't map scene cache '" << filename << "'." << std::endl;
+        return false;
+    }
+    header = (const SceneCacheHeader *)file.data();
+    if (!validate()) {
+        std::cout << "'" << filename << "' is not a valid scene cache, recompile it." << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SceneCache::close(){
+    file.close();
+    header = NULL;
+}
+
+bool SceneCache::validate() const {
+    uint64_t size = file.size();
+    if (size < sizeof(SceneCacheHeader)) { return false; }
+    if (memcmp(header->magic, SCENE_CACHE_MAGIC, sizeof(header->magic)) != 0) { return false; }
+    if (header->version != SCENE_CACHE_VERSION || header->endianTag != SCENE_CACHE_ENDIAN_TAG) { return false; }
+    if (header->headerSize != sizeof(SceneCacheHeader) || header->fileSize != size) { return false; }
+
+    // Every table has to be aligned and end inside the file. Counts are bounded by
+    // the file size first so the products below can't overflow.
+    struct { uint64_t offset, count, stride; } tables[] = {
+        { header->cameraOffset, header->hasCamera ? 1u : 0u, sizeof(CameraIO) },
+        { header->lightsOffset, header->lightCount, sizeof(SceneCacheLight) },
+        { header->materialsOffset, header->materialCount, sizeof(MaterialIO) },
+        { header->objectsOffset, header->objectCount, sizeof(SceneCacheObject) },
+        { header->positionsOffset, header->vertexCount * 3, sizeof(float) },
+        { header->normalsOffset, header->vertexCount * 3, sizeof(float) },
+        { header->texCoordsOffset, header->vertexCount * 2, sizeof(float) },
+        { header->materialIndicesOffset, header->vertexCount, sizeof(int32_t) },
+        { header->indicesOffset, header->indexCount, sizeof(uint32_t) },
+        { header->namesOffset, header->namesSize, 1 },
+    };
+    for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+        if (tables[i].offset % SCENE_CACHE_ALIGNMENT != 0 || tables[i].offset > size) { return false; }
+        if (tables[i].count > size || tables[i].count * tables[i].stride > size - tables[i].offset) { return false; }
+    }
+    if (header->vertexCount > UINT32_MAX || header->indexCount % 3 != 0) { return false; }
+    if (header->namesSize > 0 && table<char>(header->namesOffset)[header->namesSize - 1] != '\0') { return false; }
+
+    const int32_t *materialIndices = table<int32_t>(header->materialIndicesOffset);
+    const uint32_t *indices = table<uint32_t>(header->indicesOffset);
+    for (uint32_t i = 0; i < header->objectCount; i++) {
+        const SceneCacheObject &obj = object(i);
+        if (obj.type != SPHERE_OBJ && obj.type != POLYSET_OBJ) { return false; }
+        if (obj.materialCount == 0 || obj.materialFirst > header->materialCount
+            || obj.materialCount > header->materialCount - obj.materialFirst) { return false; }
+        if (obj.nameOffset >= 0 && (uint64_t)obj.nameOffset >= header->namesSize) { return false; }
+        if (obj.type != POLYSET_OBJ) { continue; }
+        if (obj.vertexFirst > header->vertexCount || obj.vertexCount > header->vertexCount - obj.vertexFirst) { return false; }
+        if (obj.indexFirst > header->indexCount || obj.triangleCount > (header->indexCount - obj.indexFirst) / 3) { return false; }
+        for (uint64_t k = 0; k < obj.triangleCount * 3; k++) {
+            if (indices[obj.indexFirst + k] >= obj.vertexCount) { return false; }
+        }
+        if (obj.materialBinding == PER_VERTEX_MATERIAL) {
+            for (uint32_t k = 0; k < obj.vertexCount; k++) {
+                int32_t m = materialIndices[obj.vertexFirst + k];
+                if (m < 0 || (uint32_t)m >= obj.materialCount) { return false; }
+            }
+        }
+    }
+    return true;
+}
+
+SceneIO* SceneCache::newSceneIO() const {
+    SceneIO *scene = (SceneIO *)calloc(1, sizeof(SceneIO));
+    if (header->hasCamera) {
+        scene->camera = new_camera();
+        *scene->camera = *table<CameraIO>(header->cameraOffset);
+    }
+    const SceneCacheLight *cached = table<SceneCacheLight>(header->lightsOffset);
+    for (uint32_t i = 0; i < header->lightCount; i++) {
+        LightIO *light = append_light(&scene->lights);
+        light->type = (LightType)cached[i].type;
+        memcpy(light->position, cached[i].position, sizeof(Point));
+        memcpy(light->direction, cached[i].direction, sizeof(Vec));
+        memcpy(light->color, cached[i].color, sizeof(Color));
+        light->dropOffRate = cached[i].dropOffRate;
+        light->cutOffAngle = cached[i].cutOffAngle;
+    }
+    return scene;
+}
+
+const char* SceneCache::name(const SceneCacheObject &object) const {
+    return object.nameOffset >= 0 ? table<char>(header->namesOffset) + object.nameOffset : NULL;
+}
+
+MeshData SceneCache::meshData(const SceneCacheObject &object) const {
+    MeshData data;
+    data.positions = table<Pos>(header->positionsOffset) + object.vertexFirst;
+    data.normals = object.normType == PER_VERTEX_NORMAL ? table<Vec3f>(header->normalsOffset) + object.vertexFirst : NULL;
+    data.texCoords = object.hasTextureCoords ? table<float>(header->texCoordsOffset) + 2 * (uint64_t)object.vertexFirst : NULL;
+    data.materialIndices = object.materialBinding == PER_VERTEX_MATERIAL ? table<int32_t>(header->materialIndicesOffset) + object.vertexFirst : NULL;
+    data.indices = table<uint32_t>(header->indicesOffset) + object.indexFirst;
+    data.vertexCount = object.vertexCount;
+    data.triangleCount = (long)object.triangleCount;
+    data.normType = (NormType)object.normType;
+    data.materialBinding = (MaterialBinding)object.materialBinding;
+    return data;
+}
@@ -0,0 +1,109 @@
+//
+//  SceneCache.h
+//  BasicRayTracer
+//
+//  Compiled binary scene (.rtscene) that is memory mapped and used in place.
+//  Layout: a fixed header, then 16-byte aligned tables, each addressed by a
+//  64-bit offset from the start of the file:
+//    camera, lights, materials, objects, positions (xyz), normals (xyz),
+//    texture coordinates (st), per-vertex material indices, triangle indices,
+//    object names.
+//  Meshes are stored as the deduplicated, indexed vertex arrays Mesh builds, so
+//  they can use the tables in place. Everything is little endian / native float,
+//  which open() checks through endianTag.
+//
+
+#ifndef __BasicRayTracer__SceneCache__
+#define __BasicRayTracer__SceneCache__
+
+#include <stdint.h>
+#include "scene_io.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#define SCENE_CACHE_MAGIC "RTSCENE"
+#define SCENE_CACHE_VERSION 2
+#define SCENE_CACHE_ENDIAN_TAG 0x01020304
+#define SCENE_CACHE_ALIGNMENT 16
+#define SCENE_CACHE_EXTENSION ".rtscene"
+
+struct SceneCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t headerSize;
+    uint32_t hasCamera;
+    uint32_t lightCount;
+    uint32_t materialCount;
+    uint32_t objectCount;
+    uint32_t pad;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t namesSize;
+    uint64_t cameraOffset;
+    uint64_t lightsOffset;
+    uint64_t materialsOffset;
+    uint64_t objectsOffset;
+    uint64_t positionsOffset;
+    uint64_t normalsOffset;
+    uint64_t texCoordsOffset;
+    uint64_t materialIndicesOffset;
+    uint64_t indicesOffset;
+    uint64_t namesOffset;
+    uint64_t fileSize;
+};
+
+struct SceneCacheLight {
+    int32_t type;       // LightType
+    float position[3];
+    float direction[3];
+    float color[3];
+    float dropOffRate;
+    float cutOffAngle;
+};
+
+struct SceneCacheObject {
+    int32_t type;               // ObjType
+    int32_t nameOffset;         // Into the names table, -1 for unnamed objects
+    uint32_t materialFirst;
+    uint32_t materialCount;
+    SphereIO sphere;            // SPHERE_OBJ only
+    int32_t normType;           // POLYSET_OBJ only from here on
+    int32_t materialBinding;
+    int32_t hasTextureCoords;
+    uint32_t pad;
+    uint32_t vertexFirst;
+    uint32_t vertexCount;
+    uint64_t indexFirst;
+    uint64_t triangleCount;
+};
+
+class SceneCache {
+private:
+    MappedFile file;
+    const SceneCacheHeader *header;
+
+    template <typename T> const T* table(uint64_t offset) const { return (const T*)(file.data() + offset); }
+    bool validate() const;
+public:
+    SceneCache():header(NULL){};
+
+    // Flatten a parsed scene into `filename`. Returns false if it can't be written.
+    static bool write(const SceneIO *scene, const char *filename);
+    static bool isCacheFileName(const char *filename);
+
+    // Map `filename` and check that every table and index stays inside the file.
+    bool open(const char *filename);
+    void close();
+
+    // Camera and lights as a SceneIO without objects; release it with deleteScene().
+    SceneIO* newSceneIO() const;
+    long objectCount() const { return header != NULL ? header->objectCount : 0; }
+    const SceneCacheObject& object(long i) const { return table<SceneCacheObject>(header->objectsOffset)[i]; }
+    const MaterialIO* materials(const SceneCacheObject &object) const { return table<MaterialIO>(header->materialsOffset) + object.materialFirst; }
+    const char* name(const SceneCacheObject &object) const;
+    // Views straight into the mapping, valid until close().
+    MeshData meshData(const SceneCacheObject &object) const;
+};
+
+#endif /* defined(__BasicRayTracer__SceneCache__) */
@@ -0,0 +1,30 @@
+//
+//  ShaderRegistry.cpp
+//  BasicRayTracer
+//
+
+#include "ShaderRegistry.h"
+#include <stdlib.h>
+#include <unordered_map>
+
+namespace {
+
+// Built on first use, so shaders can be added from anywhere during startup.
+std::unordered_map<int, surface_shader>& shaders(){
+    static std::unordered_map<int, surface_shader> table;
+    return table;
+}
+
+}
+
+void ShaderRegistry::add(const int id, surface_shader shader){
+    shaders()[id] = shader;
+}
+
+surface_shader ShaderRegistry::lookup(const char *name){
+    if (name == NULL) {
+        return NULL;
+    }
+    std::unordered_map<int, surface_shader>::const_iterator found = shaders().find(atoi(name) % 10);
+    return found != shaders().end() ? found->second : NULL;
+}
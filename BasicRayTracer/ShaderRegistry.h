@@ -0,0 +1,24 @@
+//
+//  ShaderRegistry.h
+//  BasicRayTracer
+//
+//  Procedural surface shaders, selected by object name: the last digit of a
+//  numeric name is the shader ID, so an object named "12" gets shader 2.
+//  Names are resolved once when the object is loaded; hits call the stored
+//  function pointer directly.
+//
+
+#ifndef __BasicRayTracer__ShaderRegistry__
+#define __BasicRayTracer__ShaderRegistry__
+
+#include "Ray.h"
+
+class ShaderRegistry {
+public:
+    // Shaders added later replace earlier ones with the same ID.
+    static void add(const int id, surface_shader shader);
+    // The shader selected by `name`, or NULL for unnamed objects and unregistered IDs.
+    static surface_shader lookup(const char *name);
+};
+
+#endif /* defined(__BasicRayTracer__ShaderRegistry__) */
@@ -1,14 +1,15 @@
 #include "Sphere.h"
 extern bool CHECKERBOARD(const float u, const float v);
-Sphere::Sphere(const SphereIO data, const MaterialIO material, char* _name):
+Sphere::Sphere(const SphereIO data, const uint32_t materialId, const char* _name):
 center(Pos(data.origin)),
 radius(data.radius),
 xAxis(Vec3f(data.xaxis).normalize()),
 yAxis(Vec3f(data.yaxis).normalize()),
 zAxis(Vec3f(data.zaxis).normalize()),
-material(material)
+materialId(materialId)
 {
     name = _name;
+    checkered = name != NULL && atoi(name)/10 == 1;
     radius_sq = radius*radius;
     bounds[0] = Vec3f(center.x - radius, center.y - radius, center.z - radius);
     bounds[1] = Vec3f(center.x + radius, center.y + radius, center.z + radius);
@@ -57,7 +58,7 @@ bool Sphere::intersect(Ray &ray) {
         // Intersection shader is set. We need uv coordinates, and possibly two interseciton checks.
 
         uv(intersectionNormal, u, v);
-        if(atoi(name)/10 == 1){ // Checkerboard is a 2-digit name starting with '1'.
+        if(checkered){
             if(!CHECKERBOARD(u, v)){
                 // Try again with far intersection
                 t = t_max;
@@ -72,7 +73,8 @@ bool Sphere::intersect(Ray &ray) {
     ray.t_max = t;
     ray.intersectionNormal = intersectionNormal;
     ray.currentObject = this;
-    ray.material = material;
+    ray.materialId = materialId;
+    ray.primitiveIndex = 0;
     ray.u = u;
     ray.v = v;
     return true;
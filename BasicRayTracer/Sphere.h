@@ -13,14 +13,15 @@ private:
 
     float radius;
     float radius_sq;
+    bool checkered;     // Checkerboard cutout, for 2-digit names starting with '1'
     float discriminant(const float a, const float b, const float c) const;
     float quadratic_min(const float a, const float b, const float discriminant) const;
     float quadratic_max(const float a, const float b, const float discriminant) const;
 
     void uv(const Vec3f &normal, float &u, float &v) const;
 public:
-    MaterialIO material;
-    Sphere(const SphereIO data, const MaterialIO material, char* _name);
+    uint32_t materialId;
+    Sphere(const SphereIO data, const uint32_t materialId, const char* _name);
 
     virtual bool intersect(Ray &ray);
     Vec3f normal(const Pos point) const;
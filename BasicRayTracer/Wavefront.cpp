@@ -0,0 +1,327 @@
+//
+//  Wavefront.cpp
+//  BasicRayTracer
+//
+
+#include "Wavefront.h"
+#include <algorithm>
+#include "Primitive.h"
+#include "EnvironmentMap.h"
+#include "RayStats.h"
+#include "Profiler.h"
+extern std::vector<Primitive*> objects;
+extern std::vector<Mesh*> areaLights;
+extern EnvironmentMap *environment;
+
+#pragma mark - Queues
+
+void PathQueue::clear(){
+    origin.clear();
+    direction.clear();
+    inverseDirection.clear();
+    weight.clear();
+    pixel.clear();
+    bounces.clear();
+    depth.clear();
+    importance.clear();
+    stream.clear();
+}
+
+void PathQueue::push(const Ray &ray, const Colr &_weight, const int _pixel, const int _bounces, const SampleStream &_stream,
+                     const int _depth, const float _importance){
+    origin.push_back(ray.startPosition);
+    direction.push_back(ray.direction);
+    inverseDirection.push_back(ray.inv_direction);
+    weight.push_back(_weight);
+    pixel.push_back(_pixel);
+    bounces.push_back(_bounces);
+    depth.push_back(_depth);
+    importance.push_back(_importance);
+    stream.push_back(_stream);
+}
+
+namespace {
+
+template <typename T>
+void permute(std::vector<T> &values, const std::vector<uint32_t> &order){
+    std::vector<T> sorted;
+    sorted.reserve(values.size());
+    for (uint32_t i: order) {
+        sorted.push_back(values[i]);
+    }
+    values.swap(sorted);
+}
+
+// Spreads the low 10 bits of `x` out to every third bit.
+uint64_t spreadBits(uint64_t x){
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x30000ff;
+    x = (x | (x << 8)) & 0x300f00f;
+    x = (x | (x << 4)) & 0x30c30c3;
+    x = (x | (x << 2)) & 0x9249249;
+    return x;
+}
+
+}
+
+void PathQueue::reorder(const std::vector<uint32_t> &order){
+    permute(origin, order);
+    permute(direction, order);
+    permute(inverseDirection, order);
+    permute(weight, order);
+    permute(pixel, order);
+    permute(bounces, order);
+    permute(depth, order);
+    permute(importance, order);
+    permute(stream, order);
+}
+
+Ray PathQueue::ray(const size_t i) const {
+    Ray ray = Ray(origin[i], direction[i]);
+    // The constructor normalizes again and inverts what it was given; keep the original's.
+    ray.direction = direction[i];
+    ray.inv_direction = inverseDirection[i];
+    return ray;
+}
+
+Ray PathQueue::hit(const size_t i) const {
+    Ray ray = this->ray(i);
+    ray.t_max = t[i];
+    ray.u = u[i];
+    ray.v = v[i];
+    ray.intersectionNormal = normal[i];
+    ray.currentObject = object[i];
+    ray.materialId = materialId[i];
+    ray.primitiveIndex = primitiveIndex[i];
+    return ray;
+}
+
+void GatherQueue::clear(){
+    point.clear();
+    normal.clear();
+    weight.clear();
+    pixel.clear();
+}
+
+void ShadowQueue::clear(){
+    point.clear();
+    normal.clear();
+    direction.clear();
+    contribution.clear();
+    pixel.clear();
+    test.clear();
+    distance.clear();
+    light.clear();
+}
+
+void ShadowQueue::push(const Pos &_point, const Vec3f &_normal, const Vec3f &_direction, const Colr &_contribution, const int _pixel,
+                       const ShadowTest _test, const float _distance, Mesh *_light){
+    point.push_back(_point);
+    normal.push_back(_normal);
+    direction.push_back(_direction);
+    contribution.push_back(_contribution);
+    pixel.push_back(_pixel);
+    test.push_back(_test);
+    distance.push_back(_distance);
+    light.push_back(_light);
+}
+
+#pragma mark - Stages
+
+void Wavefront::begin(const int pixelCount){
+    radiance.assign(pixelCount, Colr(0,0,0));
+    paths.clear();
+}
+
+void Wavefront::addCameraRay(const Ray &ray, const int pixel, const int bounces){
+    RAY_STAT(rays[CAMERA_RAY]);
+    paths.push(ray, Colr(1,1,1), pixel, bounces, SampleStream::current());
+}
+
+const std::vector<Colr>& Wavefront::trace(){
+    while (paths.size() > 0) {
+        extend();
+        shade();
+        gather();
+        shadow();
+        std::swap(paths, next);
+#ifdef WAVEFRONT_SORT_RAYS
+        sort();
+#endif
+    }
+    return radiance;
+}
+
+/* Orders the queued rays by direction octant, then by the Morton code of their origin's
+   cell in the queue's bounds. Ties keep their queue order, so every run traces, and adds
+   up, in the same order. */
+void Wavefront::sort(){
+    size_t count = paths.size();
+    if (count < WAVEFRONT_SORT_MIN_RAYS) { return; }
+    PROFILE_SCOPE_VALUE("sort", (long)count);
+    Vec3f lo = paths.origin[0], hi = paths.origin[0];
+    for (const Pos &origin: paths.origin) {
+        for (int axis = 0; axis < 3; axis++) {
+            lo[axis] = fmin(lo[axis], origin[axis]);
+            hi[axis] = fmax(hi[axis], origin[axis]);
+        }
+    }
+    const float cells = (1 << WAVEFRONT_MORTON_BITS) - 1;
+    Vec3f scale;
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = hi[axis] > lo[axis] ? cells / (hi[axis] - lo[axis]) : 0;
+    }
+
+    keys.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const Vec3f &d = paths.direction[i];
+        uint64_t octant = (d.x < 0) | (d.y < 0) << 1 | (d.z < 0) << 2;
+        uint64_t cell = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            cell |= spreadBits((uint64_t)((paths.origin[i][axis] - lo[axis]) * scale[axis])) << axis;
+        }
+        keys[i] = std::make_pair(octant << (3 * WAVEFRONT_MORTON_BITS) | cell, (uint32_t)i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = keys[i].second;
+    }
+    paths.reorder(order);
+}
+
+void Wavefront::extend(){
+    PROFILE_SCOPE_VALUE("extend", (long)paths.size());
+    size_t count = paths.size();
+    paths.t.resize(count);
+    paths.u.resize(count);
+    paths.v.resize(count);
+    paths.normal.resize(count);
+    paths.object.resize(count);
+    paths.materialId.resize(count);
+    paths.primitiveIndex.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        Ray ray = paths.ray(i);
+        for (Primitive *object: objects) {
+            object->intersect(ray);
+        }
+        paths.t[i] = ray.t_max;
+        if (ray.t_max == INFINITY) {
+            paths.object[i] = NULL;
+            continue;
+        }
+        paths.u[i] = ray.u;
+        paths.v[i] = ray.v;
+        paths.normal[i] = ray.intersectionNormal;
+        paths.object[i] = ray.currentObject;
+        paths.materialId[i] = ray.materialId;
+        paths.primitiveIndex[i] = ray.primitiveIndex;
+    }
+}
+
+/* What pathTrace() does at a hit, with everything it would trace queued instead. Its set
+   of objects the path is inside never gets past refraction(), which passes the old set on
+   either way, so every refraction goes from air into glass. */
+void Wavefront::shade(){
+    PROFILE_SCOPE_VALUE("shade", (long)paths.size());
+    next.clear();
+    gathers.clear();
+    shadows.clear();
+    for (size_t i = 0; i < paths.size(); i++) {
+        const int pixel = paths.pixel[i];
+        if (paths.object[i] == NULL) {
+            radiance[pixel] += paths.weight[i] * paths.ray(i).background();
+            continue;
+        }
+        Ray ray = paths.hit(i);
+        MaterialIO material = ray.shadingMaterial();
+        if (material.emissColor[0] > 0) {
+            radiance[pixel] += paths.weight[i] * Colr(material.emissColor);
+            continue;
+        }
+        SampleStream::resume(paths.stream[i]);
+        if (ray.currentObject->shader != NULL) {
+            ray.currentObject->shader(ray, material);
+        }
+        const Pos point = ray.intersectionPoint();
+
+        gathers.point.push_back(point);
+        gathers.normal.push_back(ray.intersectionNormal);
+        gathers.weight.push_back(paths.weight[i] * Colr(material.diffColor));
+        gathers.pixel.push_back(pixel);
+
+        if (environment != NULL) {
+            Vec3f directions[2];
+            Colr contributions[2];
+            int count = ray.environmentSamples(material, directions, contributions);
+            for (int s = 0; s < count; s++) {
+                shadows.push(point, ray.intersectionNormal, directions[s], paths.weight[i] * contributions[s], pixel, ENVIRONMENT_SHADOW);
+            }
+        }
+        if (!areaLights.empty()) {
+            Vec3f directions[2];
+            float distances[2];
+            Mesh *lights[2];
+            Colr contributions[2];
+            int count = ray.directLightSamples(material, directions, distances, lights, contributions);
+            for (int s = 0; s < count; s++) {
+                shadows.push(point, ray.intersectionNormal, directions[s], paths.weight[i] * contributions[s], pixel,
+                             lights[s] != NULL ? AREA_LIGHT_SHADOW : EMITTER_SHADOW, distances[s], lights[s]);
+            }
+        }
+
+        // The same roulette, in the same order, as pathTrace().
+        const int depth = paths.depth[i];
+        float reflectImportance = paths.importance[i] * specularImportance(material);
+        float refractImportance = paths.importance[i] * transmissionImportance(material);
+        float reflectSurvival, refractSurvival;
+        bool reflect = material.specColor[0] > 0 && paths.bounces[i] - 1 >= 0
+        && russianRoulette(depth, PATH_RR_MIN_DEPTH, reflectImportance, PATH_RR_MIN_SURVIVAL, PATH_RR_MAX_SURVIVAL, reflectSurvival);
+        // refraction() is called with one bounce less and takes one more itself.
+        bool refract = material.ktran > 0 && paths.bounces[i] - 2 >= 0
+        && russianRoulette(depth, PATH_RR_MIN_DEPTH, refractImportance, PATH_RR_MIN_SURVIVAL, PATH_RR_MAX_SURVIVAL, refractSurvival);
+
+        const SampleStream stream = SampleStream::current();
+        if (reflect) {
+            RAY_STAT(rays[REFLECTION_RAY]);
+            next.push(ray.reflectionRay(point), paths.weight[i] * (1.0 / reflectSurvival), pixel, paths.bounces[i] - 1, stream.split(0),
+                      depth + 1, reflectImportance);
+        }
+        if (refract) {
+            RAY_STAT(rays[REFRACTION_RAY]);
+            next.push(ray.refractionRay(point, IOR_AIR, IOR_GLASS), paths.weight[i] * (1.0 / refractSurvival), pixel, paths.bounces[i] - 2, stream.split(1),
+                      depth + 1, refractImportance);
+        }
+    }
+}
+
+void Wavefront::gather(){
+    PROFILE_SCOPE_VALUE("gather", (long)gathers.size());
+    for (size_t i = 0; i < gathers.size(); i++) {
+        radiance[gathers.pixel[i]] += gathers.weight[i] * computeRadiance(gathers.point[i], gathers.normal[i], WAVEFRONT_PHOTONS);
+    }
+}
+
+void Wavefront::shadow(){
+    PROFILE_SCOPE_VALUE("shadow", (long)shadows.size());
+    for (size_t i = 0; i < shadows.size(); i++) {
+        // Ray::shadow() starts from the hit point and its normal.
+        Ray at = Ray(shadows.point[i], shadows.direction[i]);
+        at.t_max = 0;
+        at.intersectionNormal = shadows.normal[i];
+        Colr visible;
+        switch (shadows.test[i]) {
+            case ENVIRONMENT_SHADOW:
+                visible = at.shadow(shadows.direction[i], INFINITY);
+                break;
+            case AREA_LIGHT_SHADOW:
+                visible = at.areaShadow(shadows.direction[i], shadows.distance[i], shadows.light[i]);
+                break;
+            case EMITTER_SHADOW:
+                visible = at.emittedLight(shadows.direction[i]);
+                break;
+        }
+        radiance[shadows.pixel[i]] += shadows.contribution[i] * visible;
+    }
+}
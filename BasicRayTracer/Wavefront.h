@@ -0,0 +1,137 @@
+//
+//  Wavefront.h
+//  BasicRayTracer
+//
+//  Breadth-first path tracing. Rather than following one camera sample through
+//  its recursive pathTrace() calls before starting the next, all the samples of
+//  a tile move through the tracer together, one stage at a time:
+//
+//      generate   a camera ray for every sample (Framebuffer::renderWavefront)
+//      extend     the closest hit of every queued ray
+//      shade      hits sorted into misses, emitters and surfaces; each surface
+//                 queues a photon gather, its environment and area light
+//                 samples, and the reflected and refracted rays for the next extend
+//      gather     photon map radiance for every queued surface
+//      shadow     visibility of every queued light sample
+//
+//  extend, shade, gather and shadow repeat until no rays are left. Reflected and
+//  refracted rays scatter, so before they are extended they are sorted by the
+//  octant of their direction and the Morton order of their origin: rays that
+//  start close together and head the same way then traverse one after another
+//  and find the same kd-tree nodes and triangles still in cache.
+//
+//  Each stage is
+//  one loop over a dense queue, so the code and data it needs stay in cache: the
+//  kd-trees while extending, the photon map while gathering. Queues keep every
+//  field in its own array, and each stage writes only the entries the next one
+//  needs, so the queues stay compact.
+//
+//  Radiance matches pathTrace(): the same rays, materials and shaders, added up
+//  in another order. Reflected and refracted paths draw from their own sample
+//  streams, see SampleStream::split().
+//
+
+#ifndef __BasicRayTracer__Wavefront__
+#define __BasicRayTracer__Wavefront__
+
+#include <vector>
+#include <stdint.h>
+#include "Ray.h"
+#include "SampleStream.h"
+
+#define WAVEFRONT_TILE_SIZE 64      // Pixels per side of a tile, so a queue holds up to 4096 paths per sample
+#define WAVEFRONT_PHOTONS 200       // Photons per gather, as in pathTrace()
+// Sorting pays off once the scene's kd-trees no longer fit in cache; comment this
+// out to trace secondary rays in the order they were shaded.
+#define WAVEFRONT_SORT_RAYS
+#define WAVEFRONT_SORT_MIN_RAYS 256 // Smaller queues are traced as they come
+#define WAVEFRONT_MORTON_BITS 10    // Per axis of the origin's cell
+
+/* Rays waiting to be extended, and after extend() their hits. */
+struct PathQueue {
+    std::vector<Pos> origin;
+    std::vector<Vec3f> direction;
+    std::vector<Vec3f> inverseDirection;    // As the Ray had it, for the same box tests
+    std::vector<Colr> weight;           // Scales the path's radiance on its way to the pixel
+    std::vector<int> pixel;             // In the tile
+    std::vector<int> bounces;           // Left, as pathTrace()'s `bounces`
+    std::vector<int> depth;             // As pathTrace()'s `depth` and `importance`, for Russian roulette
+    std::vector<float> importance;
+    std::vector<SampleStream> stream;
+
+    std::vector<float> t, u, v;
+    std::vector<Vec3f> normal;
+    std::vector<Primitive*> object;     // NULL for a miss
+    std::vector<uint32_t> materialId, primitiveIndex;
+
+    size_t size() const { return origin.size(); }
+    void clear();
+    void push(const Ray &ray, const Colr &weight, const int pixel, const int bounces, const SampleStream &stream,
+              const int depth = 0, const float importance = 1);
+    // Puts path order[k] at position k. Only the queued rays move, not their hits.
+    void reorder(const std::vector<uint32_t> &order);
+    // Path `i` as the Ray it was queued as.
+    Ray ray(const size_t i) const;
+    // The same with its hit, for the shading code.
+    Ray hit(const size_t i) const;
+};
+
+/* Diffuse surfaces to gather photons at. */
+struct GatherQueue {
+    std::vector<Pos> point;
+    std::vector<Vec3f> normal;
+    std::vector<Colr> weight;           // The path's weight times the diffuse color
+    std::vector<int> pixel;
+
+    size_t size() const { return point.size(); }
+    void clear();
+};
+
+/* How a light sample is tested. */
+enum ShadowTest {
+    ENVIRONMENT_SHADOW,     // Ray::shadow(), to infinity
+    AREA_LIGHT_SHADOW,      // Ray::areaShadow(), up to the point sampled on `light`
+    EMITTER_SHADOW          // Ray::emittedLight(), for a BSDF sample of the area lights
+};
+
+/* Light samples that count if nothing is in the way. */
+struct ShadowQueue {
+    std::vector<Pos> point;
+    std::vector<Vec3f> normal;
+    std::vector<Vec3f> direction;
+    std::vector<Colr> contribution;
+    std::vector<int> pixel;
+    std::vector<ShadowTest> test;
+    std::vector<float> distance;        // To the point on `light`, for AREA_LIGHT_SHADOW
+    std::vector<Mesh*> light;
+
+    size_t size() const { return point.size(); }
+    void clear();
+    void push(const Pos &point, const Vec3f &normal, const Vec3f &direction, const Colr &contribution, const int pixel,
+              const ShadowTest test, const float distance = INFINITY, Mesh *light = NULL);
+};
+
+class Wavefront {
+private:
+    PathQueue paths, next;
+    GatherQueue gathers;
+    ShadowQueue shadows;
+    std::vector<Colr> radiance;
+    std::vector<std::pair<uint64_t, uint32_t> > keys;
+
+    void sort();
+    void extend();
+    void shade();
+    void gather();
+    void shadow();
+public:
+    // Starts a tile of `pixelCount` pixels, all black.
+    void begin(const int pixelCount);
+    // Queues a camera ray for `pixel`, traced `bounces` deep like Ray::trace(). It draws from
+    // the calling thread's current sample stream.
+    void addCameraRay(const Ray &ray, const int pixel, const int bounces);
+    // Traces everything queued. Returns the sum of each pixel's samples.
+    const std::vector<Colr>& trace();
+};
+
+#endif /* defined(__BasicRayTracer__Wavefront__) */
@@ -0,0 +1,70 @@
+//
+//  WorkerPool.cpp
+//  BasicRayTracer
+//
+
+#include "WorkerPool.h"
+#include "Profiler.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned threadCount):task(NULL), count(0), next(0), busy(0), generation(0), stopping(false){
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 1; i < threadCount; i++) {
+        threads.push_back(std::thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workQueued.notify_all();
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(const long count, const std::function<void(long)> &task){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        this->count = count;
+        next = 0;
+        busy = (unsigned)threads.size();
+        generation++;
+    }
+    workQueued.notify_all();
+    drain();
+    std::unique_lock<std::mutex> lock(mutex);
+    workDone.wait(lock, [this]{ return busy == 0; });
+    this->task = NULL;
+}
+
+void WorkerPool::drain(){
+    // Items are handed out one at a time, so threads that get cheap ones simply take more.
+    for (long i = next++; i < count; i = next++) {
+        (*task)(i);
+    }
+}
+
+void WorkerPool::work(){
+    Profiler::nameThread("render worker");
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        workQueued.wait(lock, [this, &seen]{ return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        lock.unlock();
+        drain();
+        lock.lock();
+        if (--busy == 0) {
+            workDone.notify_all();
+        }
+    }
+}
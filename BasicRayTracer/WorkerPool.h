@@ -0,0 +1,46 @@
+//
+//  WorkerPool.h
+//  BasicRayTracer
+//
+//  A fixed set of render threads that is started once and reused by every job,
+//  so rendering a batch doesn't pay for thread creation per frame. The thread
+//  that calls run() works alongside the pool and returns once all items are done.
+//
+
+#ifndef __BasicRayTracer__WorkerPool__
+#define __BasicRayTracer__WorkerPool__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+class WorkerPool {
+public:
+    // threadCount includes the caller; 0 uses one per hardware thread.
+    WorkerPool(unsigned threadCount = 0);
+    ~WorkerPool();
+
+    unsigned threadCount() const { return (unsigned)threads.size() + 1; }
+    // Calls task(i) for every i in [0, count), spread over the threads, and waits for all of them.
+    void run(const long count, const std::function<void(long)> &task);
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable workQueued;
+    std::condition_variable workDone;
+    const std::function<void(long)> *task;
+    long count;
+    std::atomic<long> next;
+    unsigned busy;          // Pool threads still working on the current run
+    unsigned generation;    // Bumped by every run, so sleeping threads can tell new work from old
+    bool stopping;
+
+    void work();
+    void drain();
+};
+
+#endif /* defined(__BasicRayTracer__WorkerPool__) */
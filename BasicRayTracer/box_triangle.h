@@ -12,6 +12,7 @@
 #include "scene_io.h"
 #include "Ray.h"
 #include <stdio.h>
+#include <stdint.h>
 struct Box {
     Vec3f min;
     Vec3f max;
@@ -39,63 +40,26 @@ struct Box {
     }
 };
 class Mesh;
+// A triangle is an offset into its mesh's index buffer. Vertex data lives in
+// the mesh (see Mesh.h), so shared corners are stored once.
 class Triangle {
 public:
-    Pos p0, p1, p2;
-    Vec3f n0, n1, n2;
-    Vec3f u, v, n, provided_n;
-    VertexIO v0, v1, v2;
     Mesh &parentMesh;
-    float invDenom, uu, uv, vv;
-    PolygonIO poly;
+    uint32_t index;
     Box bounds;
-    Triangle(const PolygonIO polygon, Mesh &mesh, Vec3f provided_n):
-    parentMesh(mesh),
-    v0(polygon.vert[0]),
-    v1(polygon.vert[1]),
-    v2(polygon.vert[2]),
-    provided_n(provided_n),
-    n0(Vec3f(polygon.vert[0].norm).normalize()),
-    n1(Vec3f(polygon.vert[1].norm).normalize()),
-    n2(Vec3f(polygon.vert[2].norm).normalize()),
-    p0(Vec3f(polygon.vert[0].pos)),
-    p1(Vec3f(polygon.vert[1].pos)),
-    p2(Vec3f(polygon.vert[2].pos)),
-    u(Vec3f(polygon.vert[1].pos) - Vec3f(polygon.vert[0].pos)),
-    v(Vec3f(polygon.vert[2].pos) - Vec3f(polygon.vert[0].pos))
-{
-        bounds = getBounds();
-        uu = Vec3f::dot(u,u);
-        uv = Vec3f::dot(u,v);
-        vv = Vec3f::dot(v,v);
-        invDenom = 1.0 / (uv*uv - uu*vv);
-        n = Vec3f::cross(v, u);
-    }
+    Triangle(Mesh &mesh, uint32_t index);
+
+    inline uint32_t vertexIndex(const int corner) const;
+    inline const Pos& position(const int corner) const;
 
     bool intersect(Ray &ray) const;
-    MaterialIO interpolate(const float u,const float v,const VertexIO &v1, const VertexIO &v2, const VertexIO &v3) const;
+    MaterialIO interpolate(const float u,const float v,const MaterialIO &m1, const MaterialIO &m2, const MaterialIO &m3) const;
     Vec3f interpNormals(const float u, const float v, const Vec3f &n0, const Vec3f &n1, const Vec3f &v2) const;
 
-    float leftExtreme(int axis){
-        return fmin(p0[axis], fmin(p1[axis], p2[axis]));
-    }
-    float rightExtreme(int axis){
-        return fmax(p0[axis], fmax(p1[axis], p2[axis]));
-    }
-
-    Box getBounds(){
-        float xmin = fmin(p0.x, fmin(p1.x, p2.x));
-        float ymin = fmin(p0.y, fmin(p1.y, p2.y));
-        float zmin = fmin(p0.z, fmin(p1.z, p2.z));
-
-        float xmax = fmax(p0.x, fmax(p1.x, p2.x));
-        float ymax = fmax(p0.y, fmax(p1.y, p2.y));
-        float zmax = fmax(p0.z, fmax(p1.z, p2.z));
-
-
-        return Box(Vec3f(xmin, ymin, zmin), Vec3f(xmax, ymax, zmax));
-    }
-    float area();
+    float leftExtreme(int axis) const;
+    float rightExtreme(int axis) const;
+    Box getBounds() const;
+    float area() const;
 };
 
 #endif /* defined(__BasicRayTracer__box_triangle__) */
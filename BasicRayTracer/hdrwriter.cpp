@@ -0,0 +1,161 @@
+
+/***********************************************************************************
+	FileName: 	hdrwriter.cpp
+
+	Info:		Write float32 RGB triplets as Radiance RGBE (RLE scanlines).
+			The RLE scheme is the one hdrloader.cpp decrunches.
+************************************************************************************/
+
+#include "hdrwriter.h"
+
+#include <math.h>
+#include <string.h>
+#include <ctype.h>
+
+#define  MINELEN	8				// minimum scanline length for encoding
+#define  MAXELEN	0x7fff			// maximum scanline length for encoding
+#define  MINRUN		4				// shorter runs are cheaper as literals
+
+static void floatToRGBE(const float *col, unsigned char *rgbe);
+static void crunch(const unsigned char *data, int len, FILE *file);
+
+static bool hasExtension(const char *fileName, const char *ext)
+{
+	const char *dot = strrchr(fileName, '.');
+	if (!dot)
+		return false;
+	dot++;
+	while (*dot && *ext) {
+		if (tolower(*dot++) != *ext++)
+			return false;
+	}
+	return *dot == 0 && *ext == 0;
+}
+
+bool HDRWriter::isHDRFileName(const char *fileName)
+{
+	return hasExtension(fileName, "hdr");
+}
+
+HDRWriter::HDRWriter() : file(NULL), width(0), rgbe(NULL)
+{
+}
+
+HDRWriter::~HDRWriter()
+{
+	close();
+}
+
+bool HDRWriter::open(const char *fileName, int w, int h)
+{
+	close();
+	file = fopen(fileName, "wb");
+	if (!file)
+		return false;
+
+	width = w;
+	// hdrloader only understands the -Y +X orientation
+	fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", h, w);
+	rgbe = new unsigned char[w * 4];
+	return true;
+}
+
+bool HDRWriter::writeScanline(const float *cols)
+{
+	if (!file)
+		return false;
+
+	for (int i = 0; i < width; i++)
+		floatToRGBE(cols + i * 3, rgbe + i * 4);
+
+	if (width < MINELEN || width > MAXELEN)
+		return fwrite(rgbe, 4, width, file) == (size_t)width;
+
+	unsigned char header[4] = { 2, 2, (unsigned char)(width >> 8), (unsigned char)(width & 0xff) };
+	fwrite(header, 4, 1, file);
+
+	// components are stored one after the other, each run-length encoded
+	unsigned char *component = new unsigned char[width];
+	for (int c = 0; c < 4; c++) {
+		for (int i = 0; i < width; i++)
+			component[i] = rgbe[i * 4 + c];
+		crunch(component, width, file);
+	}
+	delete [] component;
+
+	return ferror(file) == 0;
+}
+
+void HDRWriter::close()
+{
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+	delete [] rgbe;
+	rgbe = NULL;
+}
+
+void floatToRGBE(const float *col, unsigned char *rgbe)
+{
+	float v = col[0];
+	if (col[1] > v) v = col[1];
+	if (col[2] > v) v = col[2];
+
+	if (v < 1e-32f) {
+		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+		return;
+	}
+	int expo;
+	float scale = (float)frexp(v, &expo) * 256.0f / v;
+	rgbe[0] = (unsigned char)(col[0] > 0 ? col[0] * scale : 0);
+	rgbe[1] = (unsigned char)(col[1] > 0 ? col[1] * scale : 0);
+	rgbe[2] = (unsigned char)(col[2] > 0 ? col[2] * scale : 0);
+	rgbe[3] = (unsigned char)(expo + 128);
+}
+
+// runs are written as (128 + count, value), literals as (count, bytes...)
+void crunch(const unsigned char *data, int len, FILE *file)
+{
+	int cur = 0;
+	unsigned char buf[2];
+
+	while (cur < len) {
+		int begRun = cur;
+		int runCount = 0, oldRunCount = 0;
+
+		// find the next run that is long enough to be worth encoding
+		while (runCount < MINRUN && begRun < len) {
+			begRun += runCount;
+			oldRunCount = runCount;
+			runCount = 1;
+			while (begRun + runCount < len && runCount < 127 && data[begRun] == data[begRun + runCount])
+				runCount++;
+		}
+
+		// a short run right at the start is still cheaper as a run
+		if (oldRunCount > 1 && oldRunCount == begRun - cur) {
+			buf[0] = 128 + oldRunCount;
+			buf[1] = data[cur];
+			fwrite(buf, 2, 1, file);
+			cur = begRun;
+		}
+
+		while (cur < begRun) {
+			int nonRunCount = begRun - cur;
+			if (nonRunCount > 128)
+				nonRunCount = 128;
+			buf[0] = nonRunCount;
+			fwrite(buf, 1, 1, file);
+			fwrite(data + cur, nonRunCount, 1, file);
+			cur += nonRunCount;
+		}
+
+		if (runCount >= MINRUN) {
+			buf[0] = 128 + runCount;
+			buf[1] = data[begRun];
+			fwrite(buf, 2, 1, file);
+			cur += runCount;
+		}
+	}
+}
@@ -0,0 +1,33 @@
+
+/***********************************************************************************
+	FileName: 	hdrwriter.h
+
+	Info:		Write float32 RGB triplets as Radiance RGBE (RLE scanlines).
+			Counterpart of hdrloader.h, one scanline at a time so the caller
+			never needs a second copy of the image. PFM is ImageWriter's.
+************************************************************************************/
+
+#ifndef HDRWRITER_H
+#define HDRWRITER_H
+
+#include <stdio.h>
+
+class HDRWriter {
+public:
+	HDRWriter();
+	~HDRWriter();
+
+	bool open(const char *fileName, int width, int height);
+	// scanlines go top-down, each pixel takes 3 float32, as in HDRLoaderResult
+	bool writeScanline(const float *cols);
+	void close();
+
+	static bool isHDRFileName(const char *fileName);
+
+private:
+	FILE *file;
+	int width;
+	unsigned char *rgbe;
+};
+
+#endif
@@ -7,6 +7,7 @@
 //  http://www.sci.utah.edu/~wald/PhD/wald_phd.pdf
 
 #include "kdTree.h"
+#include "RayStats.h"
 
 #pragma mark - Traversal
 
@@ -17,7 +18,9 @@ void Node::traverse(Ray &r){
 
 void Node::traverse(Ray &ray, float t_min, float t_max)
 {
+    RAY_STAT(nodesVisited);
     if (leaf) {
+        RAY_STAT(leavesVisited);
         for (auto triangle: triangles) {
             triangle->intersect(ray);
         }
@@ -53,8 +56,6 @@ void Node::traverse(Ray &ray, float t_min, float t_max)
 
 
 #pragma mark - Construction
-#define COST_TRAVERSE 1.0
-#define COST_INTERSECT 1.5
 
 void Node::splitBox(const Box& V, const SplitPlane& p, Box& VL, Box& VR) const {
     VL = V;
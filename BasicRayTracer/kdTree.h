@@ -12,6 +12,9 @@
 #include <stdio.h>
 #include "box_triangle.h"
 
+#define COST_TRAVERSE 1.0
+#define COST_INTERSECT 1.5
+
 struct SplitPlane {
     SplitPlane(const int axis, const float pos): axis(axis), pos(pos){};
     SplitPlane(){};
@@ -24,9 +27,13 @@ struct SplitPlane {
     }
 };
 
+/* A node owns its children: deleting the root frees the whole tree. */
 class Node{
 public:
-    Node():leaf(false), triangles(std::vector<Triangle*>()){};
+    Node():left(NULL), right(NULL), leaf(false), triangles(std::vector<Triangle*>()){};
+    ~Node(){ delete left; delete right; }
+    Node(const Node &) = delete;
+    Node& operator=(const Node &) = delete;
     Node *left;
     Node *right;
     bool leaf;
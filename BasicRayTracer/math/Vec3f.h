@@ -32,6 +32,10 @@ public:
     inline float lengthSq(void) const {
         return x*x + y*y + z*z;
     }
+    // Rec. 709 luminance of a linear color.
+    inline float luminance(void) const {
+        return 0.2126f*x + 0.7152f*y + 0.0722f*z;
+    }
 
     inline Vec3f& normalize(){
         float length = this->length();
@@ -1,5 +1,6 @@
 //#include <windows.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <vector>
 //#include <atlimage.h>
 #include "scene_io.h"
@@ -11,11 +12,30 @@
 #include "Ray.h"
 #include "kdTree.h"
 #include "Framebuffer.h"
+#include "hdrwriter.h"
 #include "PhotonMap.h"
+#include "EnvironmentMap.h"
+#include "SceneCache.h"
+#include "SceneBuilder.h"
+#include "MaterialTable.h"
+#include "ShaderRegistry.h"
+#include "Instance.h"
+#include "RenderJob.h"
+#include "WorkerPool.h"
+#include "Benchmark.h"
+#include "RayStats.h"
+#include "Profiler.h"
+#include "Regression.h"
+#include "KdTreeCache.h"
+#include "SampleStream.h"
+#include <deque>
+#include <string>
+#include <thread>
 #define IMAGE_WIDTH 512
 #define IMAGE_HEIGHT 512
 #define NUM_SAMPLES 1
 #define SENSOR_DISTANCE 1
+#define INSTANCE_DUPLICATE_MESHES
 
 typedef unsigned char u08;
 
@@ -23,39 +43,56 @@ SceneIO *scene = NULL;
 std::vector<LightIO*> lights;
 std::vector<Primitive*> objects;
 std::vector<Mesh*> areaLights;
+AliasTable lightDistribution;
 PhotonMap pMap;
+EnvironmentMap *environment = NULL;
+SceneCache sceneCache;
+MaterialTable materialTable;
+MeshLibrary meshLibrary;
+std::deque<std::string> objectNames;
 #pragma mark - Shaders
-void mirror(Ray &ray, const bool on);
-void earth(Ray &ray, const bool on);
+void mirror(MaterialIO &material, const bool on);
+void earth(MaterialIO &material, const bool on);
 bool CHECKERBOARD(const float u, const float v);
-void defaultShader(Ray &ray){
-    if (ray.currentObject->name == NULL) {
-        return;
-    }
-    else {
-        int shader = atoi(ray.currentObject->name);
-        switch (shader%10) {
-            case 1:
-                earth(ray, true);
-                mirror(ray, CHECKERBOARD( ray.u/2, ray.v/2));
-                break;
-            case 2:
-                earth(ray, true);
-            case 3:
-                ray.material.diffColor[0] = CHECKERBOARD(ray.u, ray.v);
-                ray.material.diffColor[1] = CHECKERBOARD(ray.u, ray.v);
-                ray.material.diffColor[2] = CHECKERBOARD(ray.u, ray.v);
-            case 4:
-                ray.material.diffColor[0] = CHECKERBOARD(ray.u*3, ray.v*3);
-                ray.material.diffColor[1] = CHECKERBOARD(ray.u*3, ray.v*3);
-                ray.material.diffColor[2] = CHECKERBOARD(ray.u*3, ray.v*3);
-            default:
-                break;
-        }
-    }
-};
+/* Procedural overrides, applied to the shading copy of the hit's material.
+   Selected by the last digit of the object name, see registerShaders().
+   Patterns follow the hit object's texture coordinates, see Primitive::textureCoords(). */
+void checkerShader(const Ray &ray, MaterialIO &material){
+    float s, t;
+    ray.currentObject->textureCoords(ray, s, t);
+    material.diffColor[0] = CHECKERBOARD(s*3, t*3);
+    material.diffColor[1] = CHECKERBOARD(s*3, t*3);
+    material.diffColor[2] = CHECKERBOARD(s*3, t*3);
+}
+
+void largeCheckerShader(const Ray &ray, MaterialIO &material){
+    float s, t;
+    ray.currentObject->textureCoords(ray, s, t);
+    material.diffColor[0] = CHECKERBOARD(s, t);
+    material.diffColor[1] = CHECKERBOARD(s, t);
+    material.diffColor[2] = CHECKERBOARD(s, t);
+    checkerShader(ray, material);
+}
 
+void earthCheckerShader(const Ray &ray, MaterialIO &material){
+    earth(material, true);
+    largeCheckerShader(ray, material);
+}
+
+void earthMirrorShader(const Ray &ray, MaterialIO &material){
+    float s, t;
+    ray.currentObject->textureCoords(ray, s, t);
+    earth(material, true);
+    mirror(material, CHECKERBOARD(s/2, t/2));
+}
 
+/* New shaders only need a line here. */
+static void registerShaders(){
+    ShaderRegistry::add(1, earthMirrorShader);
+    ShaderRegistry::add(2, earthCheckerShader);
+    ShaderRegistry::add(3, largeCheckerShader);
+    ShaderRegistry::add(4, checkerShader);
+}
 
 bool CHECKERBOARD(const float u, const float v){
     int CHECK_SIZE_X = 10;
@@ -68,97 +105,509 @@ bool CHECKERBOARD(const float u, const float v){
 }
 
 
-void earth(Ray& ray, bool on){
+void earth(MaterialIO &material, bool on){
     if(!on) { return; }
-    ray.material.diffColor[0] = 0.3;
-    ray.material.diffColor[1] = 0.3;
-    ray.material.diffColor[2] = 1;
+    material.diffColor[0] = 0.3;
+    material.diffColor[1] = 0.3;
+    material.diffColor[2] = 1;
 }
 
-void mirror(Ray &ray, bool on){
+void mirror(MaterialIO &material, bool on){
     if (!on){ return; }
-    ray.material.specColor[0] = 1;
-    ray.material.specColor[1] = 1;
-    ray.material.specColor[2] = 1;
+    material.specColor[0] = 1;
+    material.specColor[1] = 1;
+    material.specColor[2] = 1;
 
-    ray.material.diffColor[0] = 0;
-    ray.material.diffColor[1] = 0;
-    ray.material.diffColor[2] = 0;
+    material.diffColor[0] = 0;
+    material.diffColor[1] = 0;
+    material.diffColor[2] = 0;
 
-    ray.material.ambColor[0] = 0;
-    ray.material.ambColor[1] = 0;
-    ray.material.ambColor[2] = 0;
+    material.ambColor[0] = 0;
+    material.ambColor[1] = 0;
+    material.ambColor[2] = 0;
 
-    ray.material.emissColor[0] = 0;
-    ray.material.emissColor[1] = 0;
-    ray.material.emissColor[2] = 0;
+    material.emissColor[0] = 0;
+    material.emissColor[1] = 0;
+    material.emissColor[2] = 0;
 
-    ray.material.shininess = 3;
-    ray.material.ktran = 0;
+    material.shininess = 3;
+    material.ktran = 0;
 }
 
 
-static void loadScene(char *name) {
-    std::cout << "Loading scene" << name <<std::endl;
-	/* load the scene into the SceneIO data structure using given parsing code */
-	scene = readScene(name);
-
-	/* hint: use the Visual Studio debugger ("watch" feature) to probe the
-	   scene data structure and learn more about it for each of the given scenes */
-
-    /* write any code to transfer from the scene data structure to your own here */
-    /* */
-    ObjIO * nextObj = scene->objects;
-    while (nextObj != nullptr){
-        if (nextObj->type == SPHERE_OBJ) {
-            SphereIO* sphere = (SphereIO*)nextObj->data;
-            MaterialIO* material = nextObj->material;
-            objects.push_back(new Sphere(*sphere, *material, nextObj->name));
-        }
-        if( nextObj->type == POLYSET_OBJ){
-            PolySetIO* polyset = (PolySetIO*)nextObj->data;
-            MaterialIO* material = nextObj->material;
-            Mesh* mesh = new Mesh(*polyset, material, nextObj->numMaterials, nextObj->name);
-            objects.push_back(mesh);
-            if(mesh->materials[0].emissColor[0] > 0){
-                areaLights.push_back(mesh);
-            }
-        }
-        nextObj = nextObj->next;
+static void addObject(Primitive *object){
+    object->shader = ShaderRegistry::lookup(object->name);
+    objects.push_back(object);
+}
+
+static void addMesh(Mesh *mesh){
+    addObject(mesh);
+    if(materialTable[mesh->firstMaterial].emissColor[0] > 0){
+        mesh->buildLightDistribution();
+        areaLights.push_back(mesh);
+    }
+}
+
+/* A polyset that repeats an earlier mesh at another position becomes an Instance of it
+   and its own copy is dropped before any triangles or kd-tree are built for it. */
+static void addGeometry(Mesh *mesh){
+#ifdef INSTANCE_DUPLICATE_MESHES
+    // Emitters stay meshes: lights sample points on their own triangles.
+    Vec3f offset;
+    Mesh *prototype = NULL;
+    if(materialTable[mesh->firstMaterial].emissColor[0] <= 0){
+        prototype = meshLibrary.find(*mesh, offset);
+    }
+    if(prototype != NULL){
+        std::cout << "Mesh " << (mesh->name != NULL ? mesh->name : "(unnamed)") << " instances " << (prototype->name != NULL ? prototype->name : "(unnamed)") << " at offset (" << offset.x << ", " << offset.y << ", " << offset.z << ")" << std::endl;
+        addObject(new Instance(*prototype, offset, mesh->firstMaterial, mesh->name));
+        delete mesh;
+        return;
     }
+#endif
+    mesh->finish();
+    meshLibrary.add(mesh);
+    addMesh(mesh);
+}
+
+static void collectLights(){
+    // Lights are picked proportionally to emitted power (radiance * area).
+    std::vector<float> lightPower;
+    for (Mesh *light: areaLights) {
+        lightPower.push_back(Colr(materialTable[light->firstMaterial].emissColor).luminance() * light->area);
+    }
+    lightDistribution.build(lightPower);
 
     LightIO *nextLight = scene->lights;
     while (nextLight != nullptr) {
         lights.push_back(nextLight);
         nextLight = nextLight->next;
     }
+}
+
+/* Scenes compiled with --compile are mapped and meshes are built straight from the indexed arrays. */
+static void loadCompiledScene(const char *name) {
+    if (!sceneCache.open(name)) {
+        return;
+    }
+    scene = sceneCache.newSceneIO();
+    for (long i = 0; i < sceneCache.objectCount(); i++) {
+        const SceneCacheObject &obj = sceneCache.object(i);
+        const MaterialIO* material = sceneCache.materials(obj);
+        if (obj.type == SPHERE_OBJ) {
+            addObject(new Sphere(obj.sphere, materialTable.add(material, 1), sceneCache.name(obj)));
+        }
+        if (obj.type == POLYSET_OBJ) {
+            addGeometry(new Mesh(sceneCache.meshData(obj), materialTable.add(material, obj.materialCount), obj.materialCount, sceneCache.name(obj)));
+        }
+    }
+    collectLights();
+    std::cout << "Done loading" << std::endl;
+}
+
+/* Objects go straight from the parser into Spheres and Meshes, so the scene's ObjIO lists are never built. */
+class EngineSceneBuilder : public SceneBuilder {
+private:
+    Mesh *mesh;
+
+    // Parsed names only live for the callback; the primitives keep them for the shaders.
+    static const char* keepName(const char *name) {
+        if (name == NULL) {
+            return NULL;
+        }
+        objectNames.push_back(name);
+        return objectNames.back().c_str();
+    }
+public:
+    EngineSceneBuilder():mesh(NULL){};
+
+    virtual void sphere(const SphereIO &sphere, const MaterialIO *materials, long materialCount, const char *name) {
+        if (materialCount < 1) {
+            std::cout << "Sphere " << (name != NULL ? name : "(unnamed)") << " has no material, skipping it." << std::endl;
+            return;
+        }
+        addObject(new Sphere(sphere, materialTable.add(materials, 1), keepName(name)));
+    }
+    virtual void beginPolySet(const PolySetIO &polySet, const MaterialIO *materials, long materialCount, const char *name) {
+        if(polySet.type != POLYSET_TRI_MESH){ std::cout << "Polyset type " << polySet.type << " is split into triangle fans." << std::endl; }
+        mesh = new Mesh(polySet.normType, polySet.materialBinding, polySet.hasTextureCoords, materialTable.add(materials, materialCount), materialCount, keepName(name));
+    }
+    virtual void polygon(const VertexIO *vertices, long vertexCount) {
+        mesh->addPolygon(vertices, vertexCount);
+    }
+    virtual void endPolySet() {
+        addGeometry(mesh);
+        mesh = NULL;
+    }
+    virtual void abortPolySet() {
+        delete mesh;
+        mesh = NULL;
+    }
+};
+
+static void loadScene(const char *name) {
+    PROFILE_SCOPE("load scene");
+    std::cout << "Loading scene" << name <<std::endl;
+    if (SceneCache::isCacheFileName(name)) {
+        loadCompiledScene(name);
+        return;
+    }
+	/* The returned SceneIO only holds the camera and lights; objects were built as they were read. */
+    EngineSceneBuilder builder;
+	scene = streamScene(name, &builder);
+    if (scene == NULL) {
+        return;
+    }
+    collectLights();
     std::cout << "Done loading" << std::endl;
 	return;
 }
 
+/* Image-based lighting for rays that escape the scene. Without one, they return BACKGROUND_COLOR. */
+static void loadEnvironment(const char *name) {
+    environment = new EnvironmentMap();
+    if (!environment->load(name)) {
+        delete environment;
+        environment = NULL;
+    }
+}
+
 void cleanupScene(){
     if (scene != NULL) {
         deleteScene(scene);
+        scene = NULL;
+    }
+    objectNames.clear();
+    materialTable.clear();
+    meshLibrary.clear();
+    for (Primitive *object: objects) {
+        delete object;
     }
     objects.clear();
+    // Object names and compiled meshes' arrays point into the mapped cache.
+    sceneCache.close();
     lights.clear();
+    areaLights.clear();
+    pMap = PhotonMap();
 }
 
 
+#ifdef RAY_STATS
+/* Prints the counters gathered since the last report, and saves `buf`'s cost heatmap
+   as <output>_cost.bmp when there is one. */
+static void reportRayStats(const Framebuffer *buf, const std::string &output){
+    RayStats::total().print();
+    RayStats::reset();
+    if (buf != NULL) {
+        size_t dot = output.rfind('.');
+        std::string costFile = (dot == std::string::npos ? output : output.substr(0, dot)) + "_cost.bmp";
+        buf->saveCostMap(costFile.c_str());
+    }
+}
+#endif
+
 /* just a place holder, feel free to edit */
 void render(char* filename, int numSamples) {
+    PROFILE_SCOPE("render");
     pMap = Ray::buildPhotonMap();
-    Framebuffer buf = Framebuffer(IMAGE_WIDTH, IMAGE_HEIGHT, numSamples);
+    Framebuffer buf = Framebuffer(IMAGE_WIDTH, IMAGE_HEIGHT, numSamples, *scene->camera);
     std::cout << "Rendering " << filename<< std::endl;
 //    buf.renderLens(filename, SENSOR_DISTANCE);
     buf.renderPinhole(filename, SENSOR_DISTANCE);
     std::cout << "Done rendering." << std::endl;
+#ifdef RAY_STATS
+    reportRayStats(&buf, filename);
+#endif
+
+}
+
+#pragma mark - Batch mode
+
+// --wavefront: trace batch jobs breadth first, see Wavefront.h. Adaptive jobs trace depth first.
+static bool wavefront = false;
+// --stream: single-image jobs write their bands as they finish instead of holding the whole
+// image, with a fixed exposure in place of the tone mapping. Adaptive jobs and Radiance .hdr
+// output, which can't be written out of order, still render into the framebuffer.
+static bool streaming = false;
+
+static bool canStream(const RenderJob &job){
+    return streaming && job.adaptiveThreshold == 0 && !HDRWriter::isHDRFileName(job.output.c_str());
+}
+
+static void renderFrame(Framebuffer &buf, const RenderJob &job, WorkerPool &pool){
+    if (job.adaptiveThreshold > 0) {
+        buf.renderAdaptive(SENSOR_DISTANCE, job.adaptiveThreshold, pool);
+    } else if (wavefront) {
+        buf.renderWavefront(SENSOR_DISTANCE, pool);
+    } else {
+        buf.renderTiles(SENSOR_DISTANCE, pool);
+    }
+}
 
+/* Every frame of the job's camera path from the resident scene, so a frame only costs its
+   trace. A finished frame is saved on its own thread while the next one renders. */
+static void renderSequence(const RenderJob &job, WorkerPool &pool){
+    std::thread writer;
+    int frameCount = job.path.frameCount();
+    for (int frame = 0; frame < frameCount; frame++) {
+        Timer draw_timer;
+        draw_timer.start();
+        Framebuffer *buf = new Framebuffer(job.width, job.height, job.samples, job.path.cameraAt(frame, *scene->camera));
+        {
+            PROFILE_SCOPE_VALUE("frame", frame);
+            renderFrame(*buf, job, pool);
+        }
+        draw_timer.stop();
+
+        std::string filename = job.frameFilename(frame);
+        if (writer.joinable()) {
+            writer.join();
+        }
+        writer = std::thread([buf, filename]{
+            Profiler::nameThread("image writer");
+            buf->save((char *)filename.c_str());
+            delete buf;
+        });
+        std::cout << "Frame " << frame + 1 << "/" << frameCount << ", " << filename << ". Draw: " << draw_timer.getElapsedTimeInMilliSec() << "ms." << std::endl;
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+/* Renders the jobs in one process. Jobs on the same scene run back to back and share its
+   objects, kd-trees and photon map; every job renders its tiles on the same worker pool. */
+static int runJobs(std::vector<RenderJob> jobs){
+    RenderJob::groupByScene(jobs);
+    WorkerPool pool;
+    std::string loaded;
+    int failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const RenderJob &job = jobs[i];
+        Timer build_timer, draw_timer;
+        build_timer.start();
+        if (scene == NULL || job.scene != loaded) {
+            cleanupScene();
+            loaded = job.scene;
+            loadScene(job.scene.c_str());
+            if (scene != NULL) {
+                PROFILE_SCOPE("photon map");
+                pMap = Ray::buildPhotonMap();
+            }
+        }
+        build_timer.stop();
+        if (scene == NULL) {
+            std::cout << "Skipping " << job.output << ": can't load " << job.scene << std::endl;
+            failed++;
+            continue;
+        }
+        if (scene->camera == NULL) {
+            std::cout << "Skipping " << job.output << ": " << job.scene << " has no camera" << std::endl;
+            failed++;
+            continue;
+        }
+
+        draw_timer.start();
+        if (!job.path.empty()) {
+            renderSequence(job, pool);
+#ifdef RAY_STATS
+            reportRayStats(NULL, job.output);
+#endif
+        } else {
+            Framebuffer buf = Framebuffer(job.width, job.height, job.samples, job.cameraFor(scene));
+            if (canStream(job)) {
+                PROFILE_SCOPE("render");
+                buf.renderStreaming(job.output.c_str(), SENSOR_DISTANCE, pool);
+            } else {
+                {
+                    PROFILE_SCOPE("render");
+                    renderFrame(buf, job, pool);
+                }
+                buf.save((char *)job.output.c_str());
+            }
+#ifdef RAY_STATS
+            reportRayStats(&buf, job.output);
+#endif
+        }
+        draw_timer.stop();
+
+        std::cout << "Job " << i + 1 << "/" << jobs.size() << ", " << job.output << " (" << job.width << "*" << job.height
+        << ", " << job.samples << " samples per pixel). Load: " << build_timer.getElapsedTimeInMilliSec()
+        << "ms, Draw: " << draw_timer.getElapsedTimeInMilliSec() << "ms." << std::endl;
+    }
+    cleanupScene();
+    return failed == 0 ? 0 : 1;
+}
+
+#pragma mark - Regression checks
+
+/* Renders one reference scene the way every regression run does, saves its image and writes its
+   numbers to Regression::sceneResultsFile. Runs in a process of its own, so the peak memory is the scene's. */
+static int runRegressionScene(const char *directory, const char *sceneFile, const bool update){
+    // Build times are summed from the profiler's mesh scopes, and always include the SAH build.
+    Profiler::enable();
+    KdTreeCache::enabled = false;
+    WorkerPool pool(1);     // One thread, which Ray::counter counts the rays of
+    SampleStream::seed = REGRESSION_SEED;
+
+    RegressionResult result = RegressionResult(sceneFile);
+    Timer load_timer, photon_timer, render_timer;
+    uint64_t loadStart = Profiler::now();
+    load_timer.start();
+    loadScene(sceneFile);
+    load_timer.stop();
+    if (scene == NULL) {
+        std::cout << "Skipping " << result.scene << ": can't load it" << std::endl;
+        cleanupScene();
+        return 1;
+    }
+    result.loadSeconds = load_timer.getElapsedTimeInSec();
+    result.buildSeconds = Profiler::seconds("mesh", loadStart);
+
+    photon_timer.start();
+    pMap = Ray::buildPhotonMap();
+    photon_timer.stop();
+    result.photonSeconds = photon_timer.getElapsedTimeInSec();
+
+    Framebuffer buf = Framebuffer(REGRESSION_WIDTH, REGRESSION_HEIGHT, REGRESSION_SAMPLES, *scene->camera);
+    size_t rays = Ray::counter;
+    render_timer.start();
+    buf.renderTiles(SENSOR_DISTANCE, pool);
+    render_timer.stop();
+    result.renderSeconds = render_timer.getElapsedTimeInSec();
+    result.raysPerSecond = result.renderSeconds > 0 ? (Ray::counter - rays) / result.renderSeconds : 0;
+    buf.save((char *)Regression::imageFile(directory, result.scene, update).c_str());
+    result.peakKB = Regression::peakKB();
+    cleanupScene();
+
+    std::vector<RegressionResult> results(1, result);
+    return Regression::write(Regression::sceneResultsFile(directory, result.scene), results) ? 0 : 1;
+}
+
+/* Renders every reference scene the same way each time and checks the times, memory and
+   images against the baseline, or with `update`, makes them the baseline. Each scene runs in
+   a child `program --regress-scene`. See Regression.h. */
+static int runRegression(const char *program, const char *directory, const bool update){
+    if (!Regression::prepare(directory)) {
+        return 1;
+    }
+    std::vector<RegressionResult> results;
+    for (int s = 0; s < Regression::sceneCount; s++) {
+        const std::string sceneResults = Regression::sceneResultsFile(directory, Regression::scenes[s]);
+        remove(sceneResults.c_str());
+        const std::string command = std::string("\"") + program + "\" --regress-scene \"" + directory + "\" \""
+            + Regression::scenes[s] + "\"" + (update ? " update" : "");
+        std::cout.flush();
+        if (system(command.c_str()) != 0 || !Regression::read(sceneResults, results)) {
+            std::cout << "Skipping " << Regression::scenes[s] << ": its regression run failed" << std::endl;
+        }
+        remove(sceneResults.c_str());
+    }
+
+    if (!Regression::write(Regression::resultsFile(directory, update), results)) {
+        return 1;
+    }
+    if (update) {
+        std::cout << "Wrote the baseline for " << results.size() << " scenes to " << directory << std::endl;
+        return results.size() == (size_t)Regression::sceneCount ? 0 : 1;
+    }
+    return Regression::check(directory, results) && results.size() == (size_t)Regression::sceneCount ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
     Timer total_timer;
     total_timer.start();
+    registerShaders();
+
+    // BasicRayTracer --compile scene.ascii scene.rtscene: convert once, then load the .rtscene instead.
+    if (argc == 4 && strcmp(argv[1], "--compile") == 0) {
+        SceneIO *source = readScene(argv[2]);
+        if (source == NULL) {
+            return 1;
+        }
+        bool ok = SceneCache::write(source, argv[3]);
+        deleteScene(source);
+        return ok ? 0 : 1;
+    }
+
+    // BasicRayTracer --tonemap render.hdr|render.pfm image.bmp: tone map a saved linear render.
+    if (argc == 4 && strcmp(argv[1], "--tonemap") == 0) {
+        return Framebuffer::toneMapFile(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    // BasicRayTracer --benchmark [scene [results.json]]: time the kernels on the scene's objects, see Benchmark.h.
+    if (argc >= 2 && strcmp(argv[1], "--benchmark") == 0) {
+        const char *sceneFile = argc > 2 ? argv[2] : "../Scenes2/test3.ascii";
+        const char *resultsFile = argc > 3 ? argv[3] : "benchmark.json";
+        FILE *out = fopen(resultsFile, "w");
+        if (out == NULL) {
+            std::cout << "Can't open file '" << resultsFile << "' for writing." << std::endl;
+            return 1;
+        }
+        bool ok = Benchmark::run(sceneFile, out);
+        fclose(out);
+        if (ok) {
+            std::cout << "Wrote " << resultsFile << std::endl;
+        }
+        return ok ? 0 : 1;
+    }
+
+    // BasicRayTracer --regress [directory] | --regress-update [directory]: check the reference scenes against
+    // the baseline, or record it. See Regression.h.
+    if (argc >= 2 && (strcmp(argv[1], "--regress") == 0 || strcmp(argv[1], "--regress-update") == 0)) {
+        return runRegression(argv[0], argc > 2 ? argv[2] : REGRESSION_DIRECTORY, strcmp(argv[1], "--regress-update") == 0);
+    }
+    // BasicRayTracer --regress-scene directory scene [update]: one scene of the above, run by it.
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--regress-scene") == 0) {
+        return runRegressionScene(argv[2], argv[3], argc == 5 && strcmp(argv[4], "update") == 0);
+    }
+
+    // BasicRayTracer [--env map.hdr] [--trace trace.json] [--wavefront] [--stream] [--jobs jobs.txt]... [--render scene output [width [height [samples]]] [adaptive threshold] [camera ... | path file]]...
+    // Without jobs, the scene below is rendered. See RenderJob.h for the job syntax, and Profiler.h for the trace.
+    std::vector<RenderJob> jobs;
+    const char *traceFile = NULL;
+    RenderJob defaults = RenderJob("", "", IMAGE_WIDTH, IMAGE_HEIGHT, NUM_SAMPLES);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--env") == 0 && i + 1 < argc) {
+            // A Radiance .hdr latitude-longitude environment map.
+            loadEnvironment(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[++i];
+            Profiler::enable();
+        } else if (strcmp(argv[i], "--wavefront") == 0) {
+            wavefront = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            streaming = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            if (!RenderJob::readFile(argv[++i], defaults, jobs)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--render") == 0) {
+            std::vector<std::string> words;
+            while (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                words.push_back(argv[++i]);
+            }
+            RenderJob job = defaults;
+            if (!RenderJob::parse(words, job)) {
+                std::cout << "Usage: --render scene output [width [height [samples]]] [adaptive <threshold>] [camera <10 numbers> | path <file>]" << std::endl;
+                return 1;
+            }
+            jobs.push_back(job);
+        } else if (i == 1 && argv[i][0] != '-') {
+            // As before: a lone first argument is the environment map.
+            loadEnvironment(argv[i]);
+        } else {
+            std::cout << "Unknown argument " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (!jobs.empty()) {
+        int result = runJobs(jobs);
+        if (traceFile != NULL) {
+            Profiler::write(traceFile);
+        }
+        return result;
+    }
 
 
 #pragma mark - Fun scene
@@ -260,8 +709,8 @@ int main(int argc, char *argv[]) {
 //    scene5_total_timer.stop();
 
     std::cout << "Fun scene. Load: " << fun_scene_build_timer.getElapsedTimeInMilliSec()
-    << "ms, Draw: "  << fun_scene_draw_timer.getElapsedTimeInSec()
-    << "ms, Total: " << fun_scene_total_timer.getElapsedTimeInSec()
+    << "ms, Draw: "  << fun_scene_draw_timer.getElapsedTimeInMilliSec()
+    << "ms, Total: " << fun_scene_total_timer.getElapsedTimeInMilliSec()
     << "ms." << std::endl;
 
 //    std::cout << "Scene1. Load: " << scene1_build_timer.getElapsedTimeInMilliSec()
@@ -293,5 +742,8 @@ int main(int argc, char *argv[]) {
     total_timer.stop();
     std::cout << "Total time for all scenes: " << total_timer.getElapsedTimeInMilliSec() << "ms." << std::endl;
     std::cout << "Resolution was " << IMAGE_HEIGHT << "*" << IMAGE_WIDTH << ", with " << NUM_SAMPLES << " samples per pixel." << std::endl;
+    if (traceFile != NULL) {
+        Profiler::write(traceFile);
+    }
     return 1;
 }
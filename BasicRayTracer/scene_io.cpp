@@ -2,54 +2,65 @@
 #include <cstdlib>
 #include <stdio.h>
 #include "scene_io.h"
+#include "AsciiSceneReader.h"
+#include "BinarySceneReader.h"
+#include "SceneBuilder.h"
+#include "Profiler.h"
 #include <string.h>
 
+/* The fscanf reader AsciiSceneReader replaced, kept for comparison. */
+#ifdef SCENE_IO_SCANF_PARSER
 static SceneIO *readSceneA(FILE *fp);
+static void read_cameraA(SceneIO *scene, FILE *fp);
+static void read_point_lightA(SceneIO *scene, FILE *fp);
+static void read_directional_lightA(SceneIO *scene, FILE *fp);
+static void read_spot_lightA(SceneIO *scene, FILE *fp);
+static void read_objectA(ObjIO *obj, FILE *fp);
+static void read_materialA(MaterialIO *material, FILE *fp);
+static void read_sphereA(SceneIO *scene, FILE *fp);
+static void read_poly_setA(SceneIO *scene, FILE *fp);
+#endif
+
+/* The fread reader BinarySceneReader replaced, kept for comparison. */
+#ifdef SCENE_IO_FREAD_PARSER
 static SceneIO *readSceneB(FILE *fp);
+static CameraIO *read_cameraB(FILE *);
+static LightIO *read_lightsB(FILE *);
+static LightIO *read_lightB(FILE *);
+static ObjIO *read_objectsB(FILE *);
+static ObjIO *read_objectB(FILE *);
+static void read_materialB(MaterialIO *material, FILE *fp);
+static void read_sphereB(ObjIO *obj, FILE *fp);
+static void read_poly_setB(ObjIO *obj, FILE *fp);
+#endif
 
 static void write_cameraA(CameraIO *, FILE *);
-static void read_cameraA(SceneIO *scene, FILE *fp);
 static void write_cameraB(CameraIO *, FILE *);
-static CameraIO *read_cameraB(FILE *);
 static void delete_camera(CameraIO *);
 
 static void write_lightsA(LightIO *, FILE *);
 static void write_lightA(LightIO *, FILE *);
-static void read_point_lightA(SceneIO *scene, FILE *fp);
-static void read_directional_lightA(SceneIO *scene, FILE *fp);
-static void read_spot_lightA(SceneIO *scene, FILE *fp);
 static void write_lightsB(LightIO *, FILE *);
 static void write_lightB(LightIO *, FILE *);
-static LightIO *read_lightsB(FILE *);
-static LightIO *read_lightB(FILE *);
 static int get_num_lights(LightIO *);
 static void delete_lights(LightIO *);
 
 static void write_objectsA(ObjIO *, FILE *);
 static void write_objectA(ObjIO *, FILE *);
-static void read_objectA(ObjIO *obj, FILE *fp);
 static void write_objectsB(ObjIO *, FILE *);
 static void write_objectB(ObjIO *, FILE *);
-static ObjIO *read_objectsB(FILE *);
-static ObjIO *read_objectB(FILE *);
 static int get_num_objects(ObjIO *);
 static void delete_objects(ObjIO *);
 
 static void write_materialA(MaterialIO *, FILE *);
-static void read_materialA(MaterialIO *material, FILE *fp);
 static void write_materialB(MaterialIO *, FILE *);
-static void read_materialB(MaterialIO *material, FILE *fp);
 
 static void write_sphereA(ObjIO *obj, FILE *fp);
-static void read_sphereA(SceneIO *scene, FILE *fp);
 static void write_sphereB(ObjIO *obj, FILE *fp);
-static void read_sphereB(ObjIO *obj, FILE *fp);
 static void delete_sphere(SphereIO *);
 
 static void write_poly_setA(ObjIO *obj, FILE *fp);
-static void read_poly_setA(SceneIO *scene, FILE *fp);
 static void write_poly_setB(ObjIO *obj, FILE *fp);
-static void read_poly_setB(ObjIO *obj, FILE *fp);
 static void delete_poly_set(PolySetIO *);
 
 #define VERSION_STRING "Composer format"
@@ -68,6 +79,31 @@ SceneIO *newScene(void) {
 
 
 SceneIO *readScene(const char *filename) {
+	return streamScene(filename, NULL);
+}
+
+/* Readers without builder support still build the objects; pass them on and free them. */
+static void replayObjects(SceneIO *scene, SceneBuilder *builder) {
+	for (ObjIO *obj = scene->objects; obj != NULL; obj = obj->next) {
+		if (obj->type == SPHERE_OBJ) {
+			builder->sphere(*(SphereIO *)obj->data, obj->material, obj->numMaterials, obj->name);
+		} else if (obj->type == POLYSET_OBJ) {
+			PolySetIO *pset = (PolySetIO *)obj->data;
+			PolySetIO header = *pset;
+			header.poly = NULL;
+			builder->beginPolySet(header, obj->material, obj->numMaterials, obj->name);
+			for (long i = 0; i < pset->numPolys; i++) {
+				builder->polygon(pset->poly[i].vert, pset->poly[i].numVertices);
+			}
+			builder->endPolySet();
+		}
+	}
+	delete_objects(scene->objects);
+	scene->objects = NULL;
+}
+
+SceneIO *streamScene(const char *filename, SceneBuilder *builder) {
+    PROFILE_SCOPE("parse scene");
 	FILE *fp;
 	char format[50], type[20];
 	
@@ -89,14 +125,27 @@ SceneIO *readScene(const char *filename) {
 		printf( "Error: file '%s' is version %g, program is version %g.\n",
 			filename, Version, THIS_VERSION );
 	} else if (strcmp(type,"binary") == 0) {
+#ifdef SCENE_IO_FREAD_PARSER
 		scene = readSceneB(fp);
+#else
+		scene = BinarySceneReader::read(filename, ftell(fp), Version, builder);
+		builder = NULL;	/* Objects were already streamed */
+#endif
 	} else if (strcmp(type,"ascii") == 0) {
+#ifdef SCENE_IO_SCANF_PARSER
 		scene = readSceneA(fp);
+#else
+		scene = AsciiSceneReader::read(filename, ftell(fp), builder);
+		builder = NULL;	/* Objects were already streamed */
+#endif
 	} else {
 		printf( "Error: unrecognized file type (neither ascii or binary).\n" );
 	}
 
 	fclose(fp);
+	if (scene != NULL && builder != NULL) {
+		replayObjects(scene, builder);
+	}
 	return scene;
 }
 
@@ -116,6 +165,7 @@ void writeSceneAscii(SceneIO *scene, const char *filename) {
 }
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static SceneIO *readSceneA(FILE *fp) {
   SceneIO *scene = newScene();
   char word[100];
@@ -141,6 +191,7 @@ static SceneIO *readSceneA(FILE *fp) {
   }
   return scene;
 }
+#endif
 
 
 static long Test_long = 123456789;
@@ -164,6 +215,7 @@ void writeSceneBinary(SceneIO *scene, const char *filename) {
   fclose(fp);
 }
 
+#ifdef SCENE_IO_FREAD_PARSER
 static SceneIO *readSceneB(FILE *fp) {
   SceneIO *scene = newScene();
   long in_long;
@@ -185,6 +237,7 @@ static SceneIO *readSceneB(FILE *fp) {
 
   return scene;
 }
+#endif
 
 void deleteScene(SceneIO *scene) {
 	delete_camera(scene->camera);
@@ -218,6 +271,7 @@ write_cameraA(CameraIO *camera, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_cameraA(SceneIO *scene, FILE *fp)
 {
@@ -236,6 +290,7 @@ read_cameraA(SceneIO *scene, FILE *fp)
   CHECK(1, fscanf(fp," verticalFOV %g", &camera->verticalFOV));
   fscanf(fp," }");
 }
+#endif
 
 
 static void
@@ -252,6 +307,7 @@ write_cameraB(CameraIO *camera, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static CameraIO *
 read_cameraB(FILE *fp)
 {
@@ -267,10 +323,12 @@ read_cameraB(FILE *fp)
 
   if (camera->verticalFOV == 0.0) {
     /* Invalid camera -- probably we wrote all zeros (see above) */
+    delete_camera(camera);
     return NULL;
   }
   return camera;
 }
+#endif
 
 
 static void
@@ -349,6 +407,7 @@ write_lightA(LightIO *light, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_point_lightA(SceneIO *scene, FILE *fp)
 {
@@ -362,8 +421,10 @@ read_point_lightA(SceneIO *scene, FILE *fp)
 		  &light->color[1], &light->color[2]));
   fscanf(fp," }");
 }
+#endif
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_directional_lightA(SceneIO *scene, FILE *fp)
 {
@@ -377,8 +438,10 @@ read_directional_lightA(SceneIO *scene, FILE *fp)
 		  &light->color[1], &light->color[2]));
   fscanf(fp," }");
 }
+#endif
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_spot_lightA(SceneIO *scene, FILE *fp)
 {
@@ -396,6 +459,7 @@ read_spot_lightA(SceneIO *scene, FILE *fp)
   CHECK(1, fscanf(fp," cutOffAngle %g", &light->cutOffAngle));
   fscanf(fp," }");
 }
+#endif
 
 
 static void write_lightsB(LightIO *lights, FILE *fp) {
@@ -426,6 +490,7 @@ write_lightB(LightIO *light, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static LightIO *
 read_lightsB(FILE *fp)
 {
@@ -447,8 +512,10 @@ read_lightsB(FILE *fp)
   }
   return lights;
 }
+#endif
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static LightIO *
 read_lightB(FILE *fp)
 {
@@ -464,6 +531,7 @@ read_lightB(FILE *fp)
   fread(&light->cutOffAngle, sizeof(Flt), 1, fp);
   return light;
 }
+#endif
 
 
 static int
@@ -557,6 +625,7 @@ write_objectA(ObjIO *obj, FILE *fp)
   }
 }
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_objectA(ObjIO *obj, FILE *fp)
 {
@@ -584,6 +653,7 @@ read_objectA(ObjIO *obj, FILE *fp)
     read_materialA(obj->material + i, fp);
   }
 }
+#endif
 
 
 static void
@@ -628,6 +698,7 @@ write_objectB(ObjIO *obj, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static ObjIO *
 read_objectsB(FILE *fp)
 {
@@ -649,8 +720,10 @@ read_objectsB(FILE *fp)
   }
   return objects;
 }
+#endif
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static ObjIO *
 read_objectB(FILE *fp)
 {
@@ -686,6 +759,7 @@ read_objectB(FILE *fp)
   }
   return obj;
 }
+#endif
 
 
 static int
@@ -753,6 +827,7 @@ write_materialA(MaterialIO *material, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_materialA(MaterialIO *material, FILE *fp)
 {
@@ -769,6 +844,7 @@ read_materialA(MaterialIO *material, FILE *fp)
   CHECK(1, fscanf(fp," ktran %g", &material->ktran));
   fscanf(fp," }");
 }
+#endif
 
 
 static void
@@ -783,6 +859,7 @@ write_materialB(MaterialIO *material, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static void
 read_materialB(MaterialIO *material, FILE *fp)
 {
@@ -793,6 +870,7 @@ read_materialB(MaterialIO *material, FILE *fp)
   fread(&material->shininess, sizeof(Flt), 1, fp);
   fread(&material->ktran, sizeof(Flt), 1, fp);
 }
+#endif
 
 
 static void
@@ -818,6 +896,7 @@ write_sphereA(ObjIO *obj, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_sphereA(SceneIO *scene, FILE *fp)
 {
@@ -843,6 +922,7 @@ read_sphereA(SceneIO *scene, FILE *fp)
   fscanf(fp," zlength %g", &sphere->zlength);
   fscanf(fp," }");
 }
+#endif
 
 
 static void
@@ -862,6 +942,7 @@ write_sphereB(ObjIO *obj, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static void
 read_sphereB(ObjIO *obj, FILE *fp)
 {
@@ -879,6 +960,7 @@ read_sphereB(ObjIO *obj, FILE *fp)
   fread(&sphere->zaxis, sizeof(Vec), 1, fp);
   fread(&sphere->zlength, sizeof(Flt), 1, fp);
 }
+#endif
 
 
 static void
@@ -967,6 +1049,7 @@ write_poly_setA(ObjIO *obj, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_SCANF_PARSER
 static void
 read_poly_setA(SceneIO *scene, FILE *fp)
 {
@@ -1044,6 +1127,7 @@ read_poly_setA(SceneIO *scene, FILE *fp)
   }
   fscanf(fp," }");
 }
+#endif
 
 
 static void
@@ -1083,6 +1167,7 @@ write_poly_setB(ObjIO *obj, FILE *fp)
 }
 
 
+#ifdef SCENE_IO_FREAD_PARSER
 static void
 read_poly_setB(ObjIO *obj, FILE *fp)
 {
@@ -1127,6 +1212,7 @@ read_poly_setB(ObjIO *obj, FILE *fp)
     }
   }
 }
+#endif
 
 
 static void
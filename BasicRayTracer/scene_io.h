@@ -238,6 +238,12 @@ extern "C" {
 SceneIO *readScene(const char *filename);
 void deleteScene(SceneIO *);
 
+/* streamScene() is readScene(), but hands each object to `builder` as it is read
+ * (see SceneBuilder.h) instead of linking it into scene->objects.
+ */
+class SceneBuilder;
+SceneIO *streamScene(const char *filename, SceneBuilder *builder);
+
 
 /* The following routines are used to construct new scenes.  They are
  * used by "composer" when translating Inventor files.  You should not